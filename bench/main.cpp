@@ -0,0 +1,446 @@
+// Benchmark of "lot" against std::vector. Every operation is timed for several element types and sizes, and the results are written as JSON, so that they can be compared between releases.
+// Usage: lot_bench [--out file] [--filter text] [--max-elems n] [--max-bytes n] [--min-time seconds] [--max-threads n] [--counters 0|1]
+//   --filter    only run cases whose "container/type/op" name contains text
+//   --max-elems largest element count (sizes 1 to 8 for tiny lots, then growing by 16x from 16 up to 1G)
+//   --max-bytes largest size of a single container in bytes, larger sizes are skipped
+//   --max-threads largest number of threads for the concurrent appending cases (1, 2, 4, ... up to 64)
+//   --counters  1 to also count cycles, instructions, cache and TLB misses and page faults per element (Linux, with perf_event_open)
+#include "mz/lot.h"
+#include "mz/small_lot.h"
+#include "mz/segmented_lot.h"
+#include "mz/concurrent_lot.h"
+#include "mz/lot_simd.h"
+#include "mz/soa_lot.h"
+#include "mz/packed_lot.h"
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/syscall.h>
+#  include <sys/ioctl.h>
+#  include <unistd.h>
+#  include <cerrno>
+#  include <cstring>
+#endif
+using namespace std;
+using namespace std::mz;
+
+struct pod16 { float x,y,z; int id; };
+struct heavy { // Non-trivial element, with a user provided constructor and a member that owns memory
+  double w[6];
+  string tag;
+  heavy(): w{0,0,0,0,0,0},tag() {}
+};
+
+template<class T> struct elem;
+template<> struct elem<int> { static const char* name() { return "int"; } static int sample() { return 7; } };
+template<> struct elem<pod16> { static const char* name() { return "pod16"; } static pod16 sample() { return pod16{1.f,2.f,3.f,4}; } };
+template<> struct elem<string> { static const char* name() { return "string"; } static string sample() { return "element"; } };
+template<> struct elem<heavy> { static const char* name() { return "heavy"; } static heavy sample() { heavy h; h.w[0] = 1.; h.tag = "heavy"; return h; } };
+
+// Heap allocations of all containers are counted, to show how often each operation goes to the allocator
+static ui64 allocations = 0;
+struct counting_malloc: lot_malloc {
+  void* Allocate(size_t bytes,size_t align) { allocations++; return lot_malloc::Allocate(bytes,align); }
+  void* Reallocate(void* p,size_t oldbytes,size_t bytes,size_t align) { allocations++; return lot_malloc::Reallocate(p,oldbytes,bytes,align); }
+};
+template<class T> struct counting_allocator {
+  typedef T value_type;
+  counting_allocator() {}
+  template<class U> counting_allocator(const counting_allocator<U>&) {}
+  T* allocate(size_t n) { allocations++; return static_cast<T*>(malloc(n*sizeof(T))); }
+  void deallocate(T* p,size_t) { free(p); }
+  template<class U> bool operator==(const counting_allocator<U>&) const { return true; }
+  template<class U> bool operator!=(const counting_allocator<U>&) const { return false; }
+};
+
+// Each container is driven through the same set of primitives, so that every case measures the closest equivalent of the lot operation
+template<class T> struct lot_ops {
+  typedef lot<T,Acheck_def,ui32,lot_nextsize<ui32>,counting_malloc> type;
+  static const char* name() { return "lot"; }
+  static void push_back(type& c,const T& x) { c.push_back(x); }
+  static void add3(type& c,const T& x) { c.Add(x,x,x); }
+  static void add_empty(type& c) { c.AddEmpty(); }
+  static void reserve(type& c,ui64 n) { c.reserve(static_cast<ui32>(n)); }
+  static void append(type& c,const type& l) { c.Add(l); }
+  static void take(type& c,type& l) { c.Take(l); }
+  static void free(type& c) { c.Free(); }
+};
+
+template<class T> struct small_lot_ops {
+  typedef small_lot<T,8,Acheck_def,ui32,lot_nextsize<ui32>,counting_malloc> type;
+  static const char* name() { return "small_lot8"; }
+  static void push_back(type& c,const T& x) { c.push_back(x); }
+  static void add3(type& c,const T& x) { c.Add(x,x,x); }
+  static void add_empty(type& c) { c.AddEmpty(); }
+  static void reserve(type& c,ui64 n) { c.reserve(static_cast<ui32>(n)); }
+  static void append(type& c,const type& l) { c.Add(l); }
+  static void take(type& c,type& l) { c.Take(l); }
+  static void free(type& c) { c.Free(); }
+};
+
+template<class T> struct segmented_lot_ops {
+  typedef segmented_lot<T,4,Acheck_def,ui32,counting_malloc> type;
+  static const char* name() { return "segmented_lot"; }
+  static void push_back(type& c,const T& x) { c.push_back(x); }
+  static void add3(type& c,const T& x) { c.Add(x,x,x); }
+  static void add_empty(type& c) { c.AddEmpty(); }
+  static void reserve(type& c,ui64 n) { c.reserve(static_cast<ui32>(n)); }
+  static void append(type& c,const type& l) { c.Add(l); }
+  static void take(type& c,type& l) { c.Take(l); }
+  static void free(type& c) { c.Free(); }
+};
+
+template<class T> struct vector_ops {
+  typedef vector<T,counting_allocator<T>> type;
+  static const char* name() { return "vector"; }
+  static void push_back(type& c,const T& x) { c.push_back(x); }
+  static void add3(type& c,const T& x) { c.push_back(x); c.push_back(x); c.push_back(x); }
+  static void add_empty(type& c) { c.emplace_back(); }
+  static void reserve(type& c,ui64 n) { c.reserve(n); }
+  static void append(type& c,const type& l) { c.insert(c.end(),l.begin(),l.end()); }
+  static void take(type& c,type& l) { c.insert(c.end(),l.begin(),l.end()); l.clear(); }
+  static void free(type& c) { c.clear(); c.shrink_to_fit(); }
+};
+
+// Hardware and software counters of the measuring thread, in user space only, through perf_event_open. Every counter is opened on its own, so that those which the CPU, a virtual machine or perf_event_paranoid do not allow are left out, and the others still work
+class counters {
+public:
+  static const int count = 6;
+  static const char* Name(int k) {
+    static const char* const names[count] = { "cycles","instructions","l1d_misses","llc_misses","dtlb_misses","page_faults" };
+    return names[k];
+  }
+  counters() { for (int k = 0; k<count; k++) fd[k] = -1; }
+  ~counters() { Close(); }
+  counters(const counters&) = delete;
+  counters& operator=(const counters&) = delete;
+  void Open() {
+  #  ifdef __linux__
+    for (int k = 0; k<count; k++) {
+      fd[k] = OpenOne(k);
+      if (fd[k]<0) fprintf(stderr,"Counter %s is not available: %s\n",Name(k),strerror(errno));
+    }
+  #  else
+    fprintf(stderr,"Counters are only available on Linux\n");
+  #  endif
+  }
+  void Close() {
+  #  ifdef __linux__
+    for (int k = 0; k<count; k++) if (fd[k]>=0) close(fd[k]);
+  #  endif
+    for (int k = 0; k<count; k++) fd[k] = -1;
+  }
+  bool Has(int k) const { return fd[k]>=0; }
+  bool Any() const { for (int k = 0; k<count; k++) if (Has(k)) return true; return false; }
+  void Start() {
+  #  ifdef __linux__
+    for (int k = 0; k<count; k++) if (Has(k)) { ioctl(fd[k],PERF_EVENT_IOC_RESET,0); ioctl(fd[k],PERF_EVENT_IOC_ENABLE,0); }
+  #  endif
+  }
+  void Stop(double* sum) { // Adds the counts since Start to sum, scaled up if the kernel had to multiplex the counters
+  #  ifdef __linux__
+    for (int k = 0; k<count; k++) if (Has(k)) ioctl(fd[k],PERF_EVENT_IOC_DISABLE,0);
+    for (int k = 0; k<count; k++) {
+      ui64 v[3]; // Value, time enabled, time running
+      if (!Has(k) || read(fd[k],v,sizeof(v))!=static_cast<ssize_t>(sizeof(v))) continue;
+      sum[k] += v[2]!=0 ? static_cast<double>(v[0])*static_cast<double>(v[1])/static_cast<double>(v[2]) : 0;
+    }
+  #  else
+    (void)sum;
+  #  endif
+  }
+private:
+  int fd[count];
+#  ifdef __linux__
+  static int OpenOne(int k) {
+    static const ui32 types[count] = { PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HW_CACHE,PERF_TYPE_HW_CACHE,PERF_TYPE_HW_CACHE,PERF_TYPE_SOFTWARE };
+    static const ui64 configs[count] = { PERF_COUNT_HW_CPU_CYCLES,PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16),
+      PERF_COUNT_HW_CACHE_LL|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16),
+      PERF_COUNT_HW_CACHE_DTLB|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16),
+      PERF_COUNT_SW_PAGE_FAULTS };
+    perf_event_attr a;
+    memset(&a,0,sizeof(a));
+    a.size = sizeof(a);
+    a.type = types[k];
+    a.config = configs[k];
+    a.disabled = 1;
+    a.exclude_kernel = 1; // Allowed up to perf_event_paranoid 2
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open,&a,0,-1,-1,0));
+  }
+#  endif
+};
+
+struct options {
+  string out,filter;
+  ui64 maxElems = 1ull<<30;
+  ui64 maxBytes = 256ull<<20;
+  double minTime = 0.05;
+  ui64 maxThreads = 64;
+  bool counters = false;
+};
+
+struct result {
+  string container,type,op;
+  ui64 n,elems,batch,rounds;
+  double best,median; // Nanoseconds per operation
+  double allocs; // Heap allocations per operation
+  ui64 threads;
+  vector<double> counts; // Mean of every counter per operation, negative if it is not available, empty without --counters
+};
+
+class bench {
+  typedef chrono::steady_clock clk;
+  static const ui64 batchElems = 1<<14; // Small sizes are measured as a batch of containers, so that the timer resolution does not matter
+  options opt;
+  vector<result> results;
+  ui64 sink = 0;
+  counters cnt;
+
+  bool Enabled(const string& name) const { return opt.filter.empty() || name.find(opt.filter)!=string::npos; }
+
+  // Times run() over a batch of states after prep() reset them. Repeats for at least 3 rounds, until minTime was spent in run(), or 10*minTime in total (prep() can be much slower than run(), for example for move)
+  template<class State,class Prep,class Run> void Measure(const char* container,const char* type,const char* op,ui64 n,ui64 elems,Prep prep,Run run) {
+    string name = string(container)+"/"+type+"/"+op;
+    if (!Enabled(name)) return;
+    ui64 batch = MZ_max(1,batchElems/n);
+    vector<State> states(batch);
+    vector<double> times;
+    double timed = 0, allocs = 0, counts[counters::count] = {};
+    auto start = clk::now();
+    while (times.size()<3 || (timed<opt.minTime && chrono::duration<double>(clk::now()-start).count()<opt.minTime*10)) {
+      for (auto& s: states) prep(s);
+      ui64 a0 = allocations;
+      if (opt.counters) cnt.Start();
+      auto t0 = clk::now();
+      for (auto& s: states) run(s);
+      auto t1 = clk::now();
+      if (opt.counters) cnt.Stop(counts);
+      allocs = static_cast<double>(allocations-a0)/static_cast<double>(batch);
+      double t = chrono::duration<double>(t1-t0).count();
+      timed += t;
+      times.push_back(t*1e9/static_cast<double>(batch));
+      for (auto& s: states) sink += s.a.size();
+    }
+    sort(times.begin(),times.end());
+    results.push_back(result{container,type,op,n,elems,batch,times.size(),times[0],times[times.size()/2],allocs,1,vector<double>()});
+    double ops = static_cast<double>(times.size()*batch), perElem = static_cast<double>(MZ_max(1,elems));
+    if (opt.counters) for (int k = 0; k<counters::count; k++) results.back().counts.push_back(cnt.Has(k) ? counts[k]/ops : -1);
+    fprintf(stderr,"%-28s n=%-11llu %12.1f ns/op %8.3f ns/elem %8.2f allocs/op",name.c_str(),n,times[0],times[0]/perElem,allocs);
+    if (opt.counters && cnt.Has(0)) fprintf(stderr," %8.3f cycles/elem",counts[0]/ops/perElem);
+    if (opt.counters && cnt.Has(0) && cnt.Has(1) && counts[0]>0) fprintf(stderr," %5.2f ipc",counts[1]/counts[0]);
+    fprintf(stderr,"\n");
+  }
+
+  template<class Ops,class T> void RunContainer(ui64 n) {
+    typedef typename Ops::type C;
+    struct state { C a,b; };
+    const char* cn = Ops::name();
+    const char* tn = elem<T>::name();
+    const T x = elem<T>::sample();
+    C src;
+    for (ui64 i = 0; i<n; i++) Ops::push_back(src,x);
+    auto fresh = [](state& s) { Ops::free(s.a); Ops::free(s.b); };
+    auto filled = [&src](state& s) { s.a = src; s.b = src; };
+
+    Measure<state>(cn,tn,"push_back",n,n,fresh,[&](state& s) { for (ui64 i = 0; i<n; i++) Ops::push_back(s.a,x); });
+    Measure<state>(cn,tn,"add3",n,n/3*3,fresh,[&](state& s) { for (ui64 i = 0; i<n/3; i++) Ops::add3(s.a,x); });
+    Measure<state>(cn,tn,"add_empty",n,n,fresh,[&](state& s) { for (ui64 i = 0; i<n; i++) Ops::add_empty(s.a); });
+    Measure<state>(cn,tn,"reserve",n,n,fresh,[&](state& s) { for (ui64 c = 16; c<n; c *= 2) Ops::reserve(s.a,c); Ops::reserve(s.a,n); });
+    Measure<state>(cn,tn,"copy",n,n,fresh,[&](state& s) { s.a = src; });
+    Measure<state>(cn,tn,"append",n,n,filled,[&](state& s) { Ops::append(s.a,src); });
+    Measure<state>(cn,tn,"take",n,n,filled,[&](state& s) { Ops::take(s.a,s.b); });
+    Measure<state>(cn,tn,"move",n,n,[&src](state& s) { s.a = C(); s.b = src; },[&](state& s) { s.a = std::move(s.b); });
+    Measure<state>(cn,tn,"iterate",n,n,filled,[&](state& s) { ui64 sum = 0; for (auto& e: s.a) sum += *reinterpret_cast<const unsigned char*>(&e); sink += sum; });
+    Measure<state>(cn,tn,"free",n,n,filled,[&](state& s) { Ops::free(s.a); });
+  }
+
+  // Appending n ints from several threads into one container, which is created fresh (untimed) for every round. The threads are started before the clock, and released together. The counters only see the measuring thread, so they are not used here
+  template<class C,class Append> void MeasureThreads(const char* container,ui64 threads,ui64 n,Append append) {
+    string name = string(container)+"/int/append_mt";
+    if (!Enabled(name)) return;
+    vector<double> times;
+    double timed = 0, allocs = 0;
+    auto start = clk::now();
+    while (times.size()<3 || (timed<opt.minTime && chrono::duration<double>(clk::now()-start).count()<opt.minTime*10)) {
+      unique_ptr<C> c(new C());
+      atomic<bool> go(false);
+      atomic<ui64> ready(0);
+      vector<thread> pool;
+      for (ui64 t = 0; t<threads; t++) pool.emplace_back([&,t]() {
+        ready++;
+        while (!go.load()) this_thread::yield();
+        append(*c,static_cast<int>(t),n/threads+(t<n%threads ? 1 : 0));
+      });
+      while (ready.load()<threads) this_thread::yield();
+      ui64 a0 = allocations;
+      auto t0 = clk::now();
+      go = true;
+      for (auto& th: pool) th.join();
+      auto t1 = clk::now();
+      allocs = static_cast<double>(allocations-a0);
+      double t = chrono::duration<double>(t1-t0).count();
+      timed += t;
+      times.push_back(t*1e9);
+    }
+    sort(times.begin(),times.end());
+    results.push_back(result{container,"int","append_mt",n,n,1,times.size(),times[0],times[times.size()/2],allocs,threads,vector<double>()});
+    fprintf(stderr,"%-28s n=%-11llu %12.1f ns/op %8.3f ns/elem %8.2f allocs/op %3llu threads\n",name.c_str(),n,times[0],times[0]/static_cast<double>(n),allocs,threads);
+  }
+
+  void RunThreads() {
+    typedef concurrent_lot<int,Acheck_def,ui32,lot_nextsize<ui32>,counting_malloc> clot;
+    struct mutex_lot { lot<int,Acheck_def,ui32,lot_nextsize<ui32>,counting_malloc> l; mutex m; };
+    const ui64 n = MZ_min(opt.maxElems,ui64(1)<<22);
+    for (ui64 threads = 1; threads<=MZ_min(opt.maxThreads,ui64(64)); threads *= 2) {
+      MeasureThreads<clot>("concurrent_lot",threads,n,[](clot& c,int t,ui64 m) { for (ui64 i = 0; i<m; i++) c.Add(t); });
+      MeasureThreads<mutex_lot>("mutex_lot",threads,n,[](mutex_lot& c,int t,ui64 m) { for (ui64 i = 0; i<m; i++) { lock_guard<mutex> lk(c.m); c.l.Add(t); } });
+    }
+  }
+
+  // The kernels of lot_simd on every instruction set the CPU has, against plain loops over data(), in and out of the cache
+  void RunSimd() {
+    struct state { lot<float> a,b; };
+    for (ui64 n = 1<<12; n<=MZ_min(opt.maxElems,ui64(1)<<22); n *= 32) {
+      auto filled = [n](state& s) { s.a.resize(static_cast<ui32>(n)); s.b.resize(static_cast<ui32>(n)); lot_simd::Iota(s.a,1.f,0.5f); lot_simd::Fill(s.b,2.f); };
+      Measure<state>("loop","float","sum",n,n,filled,[&](state& s) { float sum = 0; for (ui32 i = 0; i<s.a.size(); i++) sum += s.a.data()[i]; sink += static_cast<ui64>(sum); });
+      Measure<state>("loop","float","dot",n,n,filled,[&](state& s) { float sum = 0; for (ui32 i = 0; i<s.a.size(); i++) sum += s.a.data()[i]*s.b.data()[i]; sink += static_cast<ui64>(sum); });
+      Measure<state>("loop","float","axpy",n,n,filled,[&](state& s) { for (ui32 i = 0; i<s.a.size(); i++) s.b.data()[i] += 0.5f*s.a.data()[i]; });
+      Measure<state>("loop","float","find",n,n,filled,[&](state& s) { ui32 i = 0; while (i<s.a.size() && s.a.data()[i]!=-1.f) i++; sink += i; });
+      for (int l = lot_simd::scalar; l<=lot_simd::Supported(); l++) {
+        if (l == lot_simd::ssse3) continue; // Runs the kernels of sse2
+        lot_simd::SetLevel(static_cast<lot_simd::level>(l));
+        string cn = string("lot_simd_")+lot_simd::Name(lot_simd::Level());
+        Measure<state>(cn.c_str(),"float","sum",n,n,filled,[&](state& s) { sink += static_cast<ui64>(lot_simd::Sum(s.a)); });
+        Measure<state>(cn.c_str(),"float","dot",n,n,filled,[&](state& s) { sink += static_cast<ui64>(lot_simd::Dot(s.a,s.b)); });
+        Measure<state>(cn.c_str(),"float","axpy",n,n,filled,[&](state& s) { lot_simd::Axpy(s.b,0.5f,s.a); });
+        Measure<state>(cn.c_str(),"float","find",n,n,filled,[&](state& s) { sink += lot_simd::Find(s.a,-1.f); });
+      }
+      lot_simd::SetLevel(lot_simd::Supported());
+    }
+  }
+
+  // Reading 2 of 9 fields, from a lot of structs and from a soa_lot with one column per field
+  void RunSoa() {
+    struct particle { double x,y,z,vx,vy,vz; float m,q; int id; };
+    typedef soa_lot<double,double,double,double,double,double,float,float,int> soa;
+    struct aos_state { lot<particle> a; };
+    struct soa_state { soa a; };
+    for (ui64 n = 1<<10; n<=MZ_min(opt.maxElems,ui64(1)<<22); n *= 32) {
+      if (n*sizeof(particle)>opt.maxBytes) break;
+      Measure<aos_state>("lot","particle","sum2",n,n,[n](aos_state& s) { s.a.resize(static_cast<ui32>(n)); for (auto& p: s.a) p = particle{1,2,3,4,5,6,7,8,9}; },
+        [&](aos_state& s) { double sum = 0; for (ui32 i = 0; i<s.a.size(); i++) sum += s.a[i].x*s.a[i].vx; sink += static_cast<ui64>(sum); });
+      Measure<soa_state>("soa_lot","particle","sum2",n,n,[n](soa_state& s) { s.a.clear(); for (ui64 i = 0; i<n; i++) s.a.Add(1,2,3,4,5,6,7,8,9); },
+        [&](soa_state& s) { sink += static_cast<ui64>(lot_simd::Dot(s.a.data<0>(),s.a.data<3>(),s.a.size())); });
+    }
+  }
+
+  void RunPacked() {
+    struct plain_state { lot<ui32> a; };
+    struct bits_state { packed_lot<lot_pack_bits> a; };
+    struct delta_state { packed_lot<lot_pack_delta> a; };
+    auto index = [](ui64 i) { return static_cast<ui32>(i*5+(i*7919)%5); }; // Sorted, with gaps below 10
+    for (ui64 n = 1<<10; n<=MZ_min(opt.maxElems,ui64(1)<<25); n *= 32) {
+      if (n*sizeof(ui32)>opt.maxBytes) break;
+      Measure<plain_state>("lot","ui32","scan",n,n,[&](plain_state& s) { s.a.clear(); for (ui64 i = 0; i<n; i++) s.a.Add(index(i)); },
+        [&](plain_state& s) { sink += lot_simd::Sum(s.a); });
+      Measure<bits_state>("packed_lot_bits","ui32","scan",n,n,[&](bits_state& s) { s.a.clear(); for (ui64 i = 0; i<n; i++) s.a.Add(index(i)); },
+        [&](bits_state& s) { s.a.ForEachBlock([&](const ui32* p,ui32 m,ui32) { sink += lot_simd::Sum(p,m); }); });
+      Measure<delta_state>("packed_lot_delta","ui32","scan",n,n,[&](delta_state& s) { s.a.clear(); for (ui64 i = 0; i<n; i++) s.a.Add(index(i)); },
+        [&](delta_state& s) { s.a.ForEachBlock([&](const ui32* p,ui32 m,ui32) { sink += lot_simd::Sum(p,m); }); });
+    }
+  }
+
+  template<class T> void RunType() {
+    for (ui64 n = 1; n<16; n *= 2) { // Tiny lots, where small_lot should avoid most allocations
+      RunContainer<lot_ops<T>,T>(n);
+      RunContainer<small_lot_ops<T>,T>(n);
+      RunContainer<segmented_lot_ops<T>,T>(n);
+      RunContainer<vector_ops<T>,T>(n);
+    }
+    for (ui64 n = 16; n<=opt.maxElems; n *= 16) {
+      if (n*sizeof(T)>opt.maxBytes) break;
+      RunContainer<lot_ops<T>,T>(n);
+      RunContainer<small_lot_ops<T>,T>(n);
+      RunContainer<segmented_lot_ops<T>,T>(n);
+      RunContainer<vector_ops<T>,T>(n);
+    }
+  }
+
+public:
+  bench(const options& o): opt(o) {
+    if (opt.counters) cnt.Open();
+  }
+
+  void Run() {
+    RunType<int>();
+    RunType<pod16>();
+    RunType<string>();
+    RunType<heavy>();
+    RunThreads();
+    RunSimd();
+    RunSoa();
+    RunPacked();
+  }
+
+  void Write(FILE* f) const {
+    fprintf(f,"{\n  \"benchmark\": \"lot_bench\",\n  \"schema\": 4,\n");
+  #  ifdef __VERSION__
+    fprintf(f,"  \"compiler\": \"%s\",\n",__VERSION__);
+  #  endif
+    fprintf(f,"  \"pointer_bits\": %u,\n",static_cast<ui32>(sizeof(void*)*8));
+    fprintf(f,"  \"results\": [");
+    for (size_t i = 0; i<results.size(); i++) {
+      const result& r = results[i];
+      double elems = static_cast<double>(MZ_max(1,r.elems));
+      fprintf(f,"%s\n    {\"container\": \"%s\", \"type\": \"%s\", \"op\": \"%s\", \"n\": %llu, \"elems\": %llu, \"batch\": %llu, \"rounds\": %llu, "
+                "\"ns_per_op_best\": %.3f, \"ns_per_op_median\": %.3f, \"ns_per_elem_best\": %.5f, \"ns_per_elem_median\": %.5f, \"allocs_per_op\": %.3f, \"threads\": %llu",
+              i ? "," : "",r.container.c_str(),r.type.c_str(),r.op.c_str(),r.n,r.elems,r.batch,r.rounds,r.best,r.median,r.best/elems,r.median/elems,r.allocs,r.threads);
+      if (!r.counts.empty()) { // "per_elem": {"cycles": .., ..} with the available counters, as means over all rounds
+        fprintf(f,", \"per_elem\": {");
+        bool first = true;
+        for (int k = 0; k<counters::count; k++) {
+          if (r.counts[static_cast<size_t>(k)]<0) continue;
+          fprintf(f,"%s\"%s\": %.5f",first ? "" : ", ",counters::Name(k),r.counts[static_cast<size_t>(k)]/elems);
+          first = false;
+        }
+        fprintf(f,"}");
+      }
+      fprintf(f,"}");
+    }
+    fprintf(f,"\n  ]\n}\n");
+  }
+};
+
+int main(int argc,char** argv) {
+  options opt;
+  for (int i = 1; i<argc; i++) {
+    string a = argv[i];
+    if (i+1>=argc) { fprintf(stderr,"Missing value for %s\n",a.c_str()); return 1; }
+    if (a=="--out") opt.out = argv[++i];
+    else if (a=="--filter") opt.filter = argv[++i];
+    else if (a=="--max-elems") opt.maxElems = strtoull(argv[++i],nullptr,10);
+    else if (a=="--max-bytes") opt.maxBytes = strtoull(argv[++i],nullptr,10);
+    else if (a=="--min-time") opt.minTime = strtod(argv[++i],nullptr);
+    else if (a=="--max-threads") opt.maxThreads = strtoull(argv[++i],nullptr,10);
+    else if (a=="--counters") opt.counters = atoi(argv[++i])!=0;
+    else { fprintf(stderr,"Unknown option %s\n",a.c_str()); return 1; }
+  }
+  bench b(opt);
+  b.Run();
+  FILE* f = opt.out.empty() ? stdout : fopen(opt.out.c_str(),"w");
+  if (!f) { fprintf(stderr,"Cannot open %s\n",opt.out.c_str()); return 1; }
+  b.Write(f);
+  if (f!=stdout) fclose(f);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "lot.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+// "concurrent_lot", a lot which many threads can append to at the same time without a lock. Appending claims slots with one atomic fetch_add on the size, and writes them while the claim is registered as active. A claim beyond the capacity fails and takes the slow path: the first failing thread becomes the grower, blocks new claims, waits until the active ones finished, and cuts the size back to the lowest failed claim (all claims after it failed as well, all before it succeeded), before it grows the lot with Tnextsize. The failed appenders then claim again. Everything but Add/AddEmpty/AddWith (reading elements, reserve, gLot, ...) must not run at the same time as appenders. The template parameters are the same as for lot.
+
+namespace std {
+  namespace mz {
+
+    template <class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,size_t Aalign = alignof(Tv),class Tconstruct = lot_construct_trivial> class concurrent_lot {
+    public:
+      typedef lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct> lot_t;
+    protected:
+      lot_t L; // Its size is only updated by gLot, its capacity is all claimable memory
+      atomic<ui64> N; // Claimed slots, including failed claims. 64 bits, so that failed claims cannot overflow it
+      atomic<ui64> failed; // Lowest failed claim, or ~0
+      atomic<Tidx> cap;
+      atomic<unsigned> active; // Appenders which are between their claim and the end of their writes
+      atomic<bool> growing;
+      mutex grow; // Held by the grower, appenders which see growing wait on it
+
+      static const ui64 none = ~ui64(0);
+      ui64 Claim(Tidx n) { // Returns the first claimed index. On return, the claim is active and has to be ended with Done()
+        for (;;) {
+          active.fetch_add(1);
+          if (growing.load()) {
+            active.fetch_sub(1);
+            lock_guard<mutex> wait(grow);
+            continue;
+          }
+          ui64 i = N.fetch_add(n);
+          if (i+n <= cap.load()) return i;
+          ui64 f = failed.load();
+          while (i < f && !failed.compare_exchange_weak(f, i)) {} // Recorded before the claim ends, so that the grower sees it
+          active.fetch_sub(1);
+          Grow(i+n);
+        }
+      }
+      void Done() { active.fetch_sub(1); }
+      void Grow(ui64 need) {
+        lock_guard<mutex> lk(grow);
+        if (failed.load() == none) return; // Another thread already grew the lot
+        growing.store(true);
+        while (active.load() != 0) this_thread::yield(); // Only in-flight writes, which are short
+        ui64 valid = failed.load();
+        need = MZ_max(need, valid+1);
+        if (need > static_cast<ui64>(numeric_limits<Tidx>::max())) {
+          Resume(valid);
+          throw length_error("concurrent_lot: Tidx is too small for more elements\n");
+        }
+        try { L.reserve(MZ_max(static_cast<Tidx>(need),Tnextsize().nextsize(L.capacity()))); }
+        catch (...) { Resume(valid); throw; } // bad_alloc, the failed appenders can claim (and fail) again
+        cap.store(L.capacity());
+        Resume(valid);
+      }
+      void Resume(ui64 valid) { // Drops the failed claims and lets the appenders claim again
+        N.store(valid);
+        failed.store(none);
+        growing.store(false);
+      }
+    public:
+      typedef Tv lot_type;
+      concurrent_lot():N(0),failed(none),cap(0),active(0),growing(false) {}
+      explicit concurrent_lot(Tidx startCap):concurrent_lot() { reserve(startCap); }
+      concurrent_lot(const concurrent_lot&) = delete;
+      concurrent_lot& operator=(const concurrent_lot&) = delete;
+
+      // Concurrent appending. Returns the index of the (first) new element
+      Tidx Add(const Tv& arg) { return AddWith(1, [&arg](Tv* p) { *p = arg; }); }
+      template<typename ...Args> Tidx Add(const Tv& arg,Args ...args) {
+        const Tv items[] = { arg, static_cast<Tv>(args)... };
+        return Add(items, static_cast<Tidx>(sizeof...(Args)+1));
+      }
+      Tidx Add(const Tv* items,Tidx n) { return AddWith(n, [items,n](Tv* p) { Tconstruct::Copy(p, items, n); }); }
+      template<class F> Tidx AddWith(Tidx n,F f) { // Claims n slots and calls f(p) with the pointer to the first one. p is only valid within f, because the lot may move when it grows
+        ui64 i = Claim(n);
+        try { f(L.data()+i); }
+        catch (...) { Done(); throw; }
+        Done();
+        return static_cast<Tidx>(i);
+      }
+      Tv* AddEmpty() { // The pointer is only valid until the lot grows, unless enough was reserved before, or Talloc is lot_inplace (like lot_vmreserve)
+        ui64 i = Claim(1);
+        Tv* p = L.data()+i;
+        Done();
+        return p;
+      }
+
+      // Everything below must not be used while other threads append
+      inli Tidx size() const { return static_cast<Tidx>(MZ_min(N.load(), failed.load())); }
+      inli Tidx capacity() const { return cap.load(); }
+      void reserve(Tidx ncap) {
+        L.reserve(ncap);
+        cap.store(L.capacity());
+      }
+      void clear() { N.store(0); failed.store(none); }
+      inli Tv& operator[] (Tidx i) {
+        if (Acheck && i >= size()) throw out_of_range("Lot access out of range!\n");
+        return L.UncheckedAt(i);
+      }
+      inli Tv* data() { return L.data(); }
+      inli Tv* begin() { return L.data(); }
+      inli Tv* end() { return L.data()+size(); }
+      lot_t& gLot() { // The lot with all appended elements, for example to Take them
+        L.resize(size());
+        return L;
+      }
+      void Take(lot_t& l) { // Appends the elements of l
+        gLot().Take(l);
+        N.store(L.size());
+        cap.store(L.capacity());
+      }
+    };
+
+  }
+}
@@ -9,7 +9,26 @@
 #include <iterator>
 #include <cstring>
 #include <algorithm>
+#include <type_traits>
+#include <limits>
+#include <cstddef>
 #include <stdlib.h> 
+#if defined(_MSC_VER) || defined(__GLIBC__)
+#  include <malloc.h>
+#elif defined(__APPLE__)
+#  include <malloc/malloc.h>
+#elif defined(__FreeBSD__)
+#  include <malloc_np.h>
+#endif
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+#ifdef __linux__
+#  include <stdio.h>
+#  include <stdint.h>
+#  include <sys/mman.h>
+#endif
+#include "lot_hooks.h"
 // "lot", a simplified, faster std::vector. Unlike std::vector or other STL containers, elements are constructed/destructed on internal memory reservation, instead of element insertion/removal/resizing. This means that an element returned by add() already has an undefined, but valid state (either the result of the default constructor, or whatever was the last content). "lot" has basic support for assignment and copy construction, as well as iterators for auto-loops. Move-assignment and -construction are in principle also supported, but Visual C++ appears to have some problems with that in some cases, so it cannot be fully confirmed that it works. If Acheck=true, the array operator uses boundary checks. Tnextsize controls the function which defines the memory allocation pattern during growth.
 
 // "lots" is an adapter which is specifically designed to make GPU memory transfers more pleasent to use, and make CPU debugging easier, by replacing the GPU-memory adapter with a ranged-checked CPU-memory adapter (assuming the rest of the GPU code is also available as CPU code)
@@ -28,6 +47,21 @@
 #   define inli __forceinline
 # endif
 
+#ifndef lot_hooks_def
+# define lot_hooks_def lot_nohooks // Instrumentation of every lot which does not name its Thooks, see lot_hooks.h
+#endif
+
+#ifndef Astream_def
+# define Astream_def (size_t(32) << 20) // Bulk copies of at least this many bytes use non-temporal stores, see lot_memcpy
+#endif
+
+#ifdef MZ_LOT_USDT // Static probes of the provider mz_lot, for bpftrace, perf and SystemTap (see README). Without MZ_LOT_USDT, they are not compiled at all, with it, each is a nop until a tracer attaches
+# include <sys/sdt.h>
+# define MZ_LOT_PROBE(name,...) STAP_PROBEV(mz_lot,name,__VA_ARGS__)
+#else
+# define MZ_LOT_PROBE(name,...)
+#endif
+
 #define Ctypecopy(name) typedef const name C##name
 #define Ctypedef(type,name) typedef type name; Ctypecopy(name)
 
@@ -45,7 +79,290 @@ namespace std {
       Tidx nextsize(Tidx olds) const { return static_cast<Tidx>((static_cast<double>(olds)*1.5)+4); }
     };
 
-    template <class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>> class lot {
+    // Elements of types for which lot_relocatable is true are moved to new memory with memcpy during reserve, all others are move-constructed there. Specialize it for own types which do not point into themselves (unlike, for example, std::string with small string optimization).
+    template<class Tv> struct lot_relocatable: integral_constant<bool,is_trivially_copyable<Tv>::value> {};
+    // Allocation policies for which lot_inplace is true never move memory in Reallocate, so that reserve uses it for all types, not only the relocatable ones.
+    template<class Talloc> struct lot_inplace: false_type {};
+
+    // Which kind of memory a lot actually got, see lot_backing_of
+    struct lot_backing {
+      enum kind_t { none, heap, pages, transparent, hugetlb } kind; // pages = mmapped with regular pages, transparent = (partially) transparent huge pages
+      size_t pageSize, hugeBytes;
+      const char* Name() const {
+        static const char* names[] = { "none","heap","pages","transparent","hugetlb" };
+        return names[kind];
+      }
+    };
+
+    // Bulk copies of trivially copyable memory, used for copying, appending and relocating lots. lot_memcpy_stream writes with non-temporal stores, which bypass the caches, so that a huge copy does not evict the working set (and does not read the destination first). lot_memcpy uses it for copies of at least Astream_def bytes, and memcpy (which is vectorized anyway) for everything smaller.
+    inline void lot_memcpy_stream(void* dst,const void* src,size_t bytes) {
+    #  if defined(__SSE2__)
+      unsigned char* d = static_cast<unsigned char*>(dst);
+      const unsigned char* s = static_cast<const unsigned char*>(src);
+      size_t head = MZ_min((16 - (reinterpret_cast<size_t>(d) & 15)) & 15, bytes); // Streaming stores need an aligned destination
+      memcpy(d,s,head);
+      d += head;
+      s += head;
+      bytes -= head;
+      size_t body = bytes & ~size_t(63);
+      for (size_t i = 0; i < body; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+i+16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+i+32));
+        __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+i+48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d+i),a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d+i+16),b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d+i+32),c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(d+i+48),e);
+      }
+      _mm_sfence(); // Streaming stores are weakly ordered
+      memcpy(d+body,s+body,bytes-body);
+    #  else
+      memcpy(dst,src,bytes);
+    #  endif
+    }
+    inline void lot_memcpy(void* dst,const void* src,size_t bytes) {
+      if (bytes >= Astream_def) lot_memcpy_stream(dst,src,bytes);
+      else if (bytes != 0) memcpy(dst,src,bytes);
+    }
+
+    // Allocation policies provide the raw memory of a lot, aligned to at least align bytes (a power of two). Reallocate must keep the content and the alignment, and may only be called for memory from the same policy. Usable returns how many bytes of a block can actually be used, which may be more than requested; lot uses the difference as additional capacity. The *Zeroed variants (only used with lot_construct_zero) must return memory whose new part, including the slack reported by Usable, is zero.
+    // A lot keeps its policy as an (empty) base class, so stateless policies cost nothing, while stateful ones (arenas, pools, ...) are copied on copy construction and moved along with the memory on move and Take.
+    struct lot_malloc {
+      static bool Overaligned(size_t align) { return align>alignof(max_align_t); } // malloc alone is enough otherwise
+      void* Allocate(size_t bytes,size_t align) {
+        if (!Overaligned(align)) return malloc(bytes);
+      #  ifdef _MSC_VER
+        return _aligned_malloc(bytes,align);
+      #  else
+        void* p;
+        return posix_memalign(&p,align,bytes)==0 ? p : nullptr;
+      #  endif
+      }
+      void* Reallocate(void* p,size_t oldbytes,size_t bytes,size_t align) { // realloc can grow in place, and glibc moves large (mmapped) blocks with mremap instead of copying them
+        if (!Overaligned(align)) return realloc(p,bytes);
+      #  ifdef _MSC_VER
+        static_cast<void>(oldbytes);
+        return _aligned_realloc(p,bytes,align);
+      #  else
+        void* q = Allocate(bytes,align); // Not realloc, which may return misaligned memory after it already released p, so that p could not stay valid when the aligned copy fails
+        if (q!=nullptr) {
+          lot_memcpy(q,p,MZ_min(oldbytes,bytes));
+          free(p);
+        }
+        return q;
+      #  endif
+      }
+      void Deallocate(void* p,size_t,size_t align) {
+      #  ifdef _MSC_VER
+        if (Overaligned(align)) { _aligned_free(p); return; }
+      #  else
+        static_cast<void>(align);
+      #  endif
+        free(p);
+      }
+      size_t Usable(void*,size_t bytes,size_t) { return bytes; }
+      void* AllocateZeroed(size_t bytes,size_t align) {
+        if (!Overaligned(align)) return calloc(1,bytes);
+        void* p = Allocate(bytes,align);
+        if (p!=nullptr) memset(p,0,bytes);
+        return p;
+      }
+      void* ReallocateZeroed(void* p,size_t oldbytes,size_t bytes,size_t align) { // calloc and copy instead of realloc, so that the new part does not have to be cleared (large calloc blocks are fresh zero pages)
+        if (bytes<=oldbytes) return Reallocate(p,oldbytes,bytes,align);
+        void* q = AllocateZeroed(bytes,align);
+        if (q!=nullptr) {
+          lot_memcpy(q,p,oldbytes);
+          Deallocate(p,oldbytes,align);
+        }
+        return q;
+      }
+      static lot_backing Backing(const void* p,size_t) { return lot_backing{ p ? lot_backing::heap : lot_backing::none,4096,0 }; }
+    };
+
+    // Like lot_malloc, but claims the slack of the malloc size classes as capacity (works with glibc, jemalloc, tcmalloc, MSVC and macOS)
+    struct lot_malloc_usable: lot_malloc {
+      size_t Usable(void* p,size_t bytes,size_t align) {
+      #  if defined(_MSC_VER)
+        return MZ_max(bytes,Overaligned(align) ? _aligned_msize(p,align,0) : _msize(p));
+      #  else
+        static_cast<void>(align);
+      #    if defined(__APPLE__)
+        return MZ_max(bytes,malloc_size(p));
+      #    elif defined(__GLIBC__) || defined(__FreeBSD__)
+        return MZ_max(bytes,malloc_usable_size(p));
+      #    else
+        return p ? bytes : 0;
+      #    endif
+      #  endif
+      }
+      void* AllocateZeroed(size_t bytes,size_t align) { return ClearSlack(lot_malloc::AllocateZeroed(bytes,align),bytes,align); }
+      void* ReallocateZeroed(void* p,size_t oldbytes,size_t bytes,size_t align) { return ClearSlack(lot_malloc::ReallocateZeroed(p,oldbytes,bytes,align),bytes,align); }
+      void* ClearSlack(void* p,size_t bytes,size_t align) { // Not every allocator clears the whole block in calloc
+        if (p!=nullptr) memset(reinterpret_cast<char*>(p)+bytes,0,Usable(p,bytes,align)-bytes);
+        return p;
+      }
+    };
+
+  #  ifdef __linux__
+    static const size_t lot_hugepage_size = size_t(2) << 20;
+
+    // Allocation policy for large lots: blocks of at least Threshold bytes are mmapped with 2 MiB alignment, rounded up to whole huge pages (which lot uses as additional capacity) and marked with madvise(MADV_HUGEPAGE) for transparent huge pages. Smaller blocks come from malloc. With Hugetlb=true, explicit MAP_HUGETLB pages are tried first, which requires reserved pages in /proc/sys/vm/nr_hugepages. Growth moves the pages with mremap instead of copying them. Use lot_backing_of to find out what a lot actually got.
+    template<size_t Threshold = lot_hugepage_size,bool Hugetlb = false> struct lot_hugepage: lot_malloc {
+      static size_t Round(size_t bytes) { return (bytes+lot_hugepage_size-1) & ~(lot_hugepage_size-1); }
+      static bool Large(size_t bytes) { return bytes>=Threshold; }
+      static char* Map(size_t bytes) { // 2 MiB aligned anonymous mapping, obtained by trimming a larger one
+        void* raw = mmap(nullptr,bytes+lot_hugepage_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if (raw==MAP_FAILED) return nullptr;
+        char* r = reinterpret_cast<char*>(raw);
+        char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(r)+lot_hugepage_size-1) & ~(lot_hugepage_size-1));
+        if (p!=r) munmap(r,static_cast<size_t>(p-r));
+        if (p+bytes!=r+bytes+lot_hugepage_size) munmap(p+bytes,static_cast<size_t>(r+lot_hugepage_size-p));
+        madvise(p,bytes,MADV_HUGEPAGE);
+        return p;
+      }
+      void* Allocate(size_t bytes,size_t align) { // Alignments beyond 2 MiB are not supported
+        if (!Large(bytes)) return lot_malloc::Allocate(bytes,align);
+        bytes = Round(bytes);
+        if (Hugetlb) {
+          void* p = mmap(nullptr,bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+          if (p!=MAP_FAILED) return p;
+        }
+        return Map(bytes);
+      }
+      void* Reallocate(void* p,size_t oldbytes,size_t bytes,size_t align) {
+        if (!Large(oldbytes) && !Large(bytes)) return lot_malloc::Reallocate(p,oldbytes,bytes,align);
+        if (Large(oldbytes) && Large(bytes)) {
+          oldbytes = Round(oldbytes);
+          bytes = Round(bytes);
+          if (bytes==oldbytes) return p;
+          void* q = mremap(p,oldbytes,bytes,0); // In place, which always works for shrinking
+          if (q!=MAP_FAILED) return q;
+          q = Map(bytes); // Otherwise, move the old pages to the start of a new aligned block
+          if (q==nullptr) return nullptr;
+          if (mremap(p,oldbytes,oldbytes,MREMAP_MAYMOVE|MREMAP_FIXED,q)!=MAP_FAILED) return q;
+          q = Map(bytes); // Not possible for hugetlb pages on older kernels, which unmap the target before they find that out, so the pages are copied to a fresh block
+          if (q==nullptr) return nullptr;
+          lot_memcpy(q,p,oldbytes);
+          munmap(p,oldbytes);
+          return q;
+        }
+        void* q = Allocate(bytes,align); // Between heap and mmapped memory
+        if (q==nullptr) return nullptr;
+        lot_memcpy(q,p,MZ_min(oldbytes,bytes));
+        Deallocate(p,oldbytes,align);
+        return q;
+      }
+      void Deallocate(void* p,size_t bytes,size_t align) {
+        if (!Large(bytes)) lot_malloc::Deallocate(p,bytes,align); else munmap(p,Round(bytes));
+      }
+      size_t Usable(void*,size_t bytes,size_t) { return Large(bytes) ? Round(bytes) : bytes; }
+      void* AllocateZeroed(size_t bytes,size_t align) { return Large(bytes) ? Allocate(bytes,align) : lot_malloc::AllocateZeroed(bytes,align); } // mmapped memory is always zero
+      void* ReallocateZeroed(void* p,size_t oldbytes,size_t bytes,size_t align) {
+        if (bytes<=oldbytes || Large(bytes)) return Reallocate(p,oldbytes,bytes,align); // Pages added by mremap or mmap are zero
+        return lot_malloc::ReallocateZeroed(p,oldbytes,bytes,align);
+      }
+      static lot_backing Backing(const void* p,size_t bytes) { // Reads the mapping which contains p from /proc/self/smaps
+        lot_backing b{ lot_backing::none,4096,0 };
+        if (p==nullptr) return b;
+        b.kind = Large(bytes) ? lot_backing::pages : lot_backing::heap;
+        FILE* f = fopen("/proc/self/smaps","r");
+        if (f==nullptr) return b;
+        char line[512];
+        bool inside = false;
+        uintptr_t a = reinterpret_cast<uintptr_t>(p);
+        while (fgets(line,sizeof(line),f)) {
+          unsigned long start,end,kb;
+          if (sscanf(line,"%lx-%lx ",&start,&end)==2) {
+            if (inside) break;
+            inside = a>=start && a<end;
+          }
+          else if (inside && sscanf(line,"KernelPageSize: %lu kB",&kb)==1) b.pageSize = kb*1024;
+          else if (inside && sscanf(line,"AnonHugePages: %lu kB",&kb)==1) b.hugeBytes = kb*1024;
+        }
+        fclose(f);
+        if (b.pageSize>4096) {
+          b.kind = lot_backing::hugetlb;
+          b.hugeBytes = Round(bytes);
+        }
+        else if (b.hugeBytes!=0 && b.kind==lot_backing::pages) b.kind = lot_backing::transparent;
+        return b;
+      }
+    };
+
+    // Allocation policy which reserves Reserve bytes of address space (PROT_NONE, so it costs no memory) for every lot, and commits them with mprotect in steps of Commit bytes as the lot grows. The lot therefore never moves, data() stays the same for its whole life, and growth never copies, for all element types. Shrinking decommits the pages with madvise(MADV_DONTNEED). Lots beyond Reserve bytes fail with bad_alloc. Commit must be a multiple of the page size.
+    template<size_t Reserve = (size_t(64) << 30),size_t Commit = (size_t(64) << 10)> struct lot_vmreserve {
+      static_assert(Commit!=0 && Commit%4096==0 && Reserve%Commit==0,"lot_vmreserve: Commit must be a multiple of the page size, and Reserve of Commit");
+      static size_t Round(size_t bytes) { return (bytes+Commit-1)/Commit*Commit; }
+      void* Allocate(size_t bytes,size_t align) {
+        if (bytes>Reserve) return nullptr;
+        size_t extra = align>4096 ? align : 0; // mmap only guarantees page alignment, more is obtained by trimming
+        void* raw = mmap(nullptr,Reserve+extra,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+        if (raw==MAP_FAILED) return nullptr;
+        char* r = reinterpret_cast<char*>(raw);
+        char* p = extra ? reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(r)+align-1) & ~(align-1)) : r;
+        if (p!=r) munmap(r,static_cast<size_t>(p-r));
+        if (p+Reserve!=r+Reserve+extra) munmap(p+Reserve,static_cast<size_t>(r+extra-p));
+        if (mprotect(p,Round(bytes),PROT_READ|PROT_WRITE)!=0) {
+          munmap(p,Reserve);
+          return nullptr;
+        }
+        return p;
+      }
+      void* Reallocate(void* p,size_t oldbytes,size_t bytes,size_t) {
+        if (bytes>Reserve) return nullptr;
+        char* c = reinterpret_cast<char*>(p);
+        size_t o = Round(oldbytes), n = Round(bytes);
+        if (n>o && mprotect(c+o,n-o,PROT_READ|PROT_WRITE)!=0) return nullptr;
+        if (n<o) {
+          madvise(c+n,o-n,MADV_DONTNEED); // Gives the memory back, the pages read as zero when they are committed again
+          mprotect(c+n,o-n,PROT_NONE);
+        }
+        return p;
+      }
+      void Deallocate(void* p,size_t,size_t) { munmap(p,Reserve); }
+      size_t Usable(void*,size_t bytes,size_t) { return MZ_min(Round(bytes),Reserve); }
+      void* AllocateZeroed(size_t bytes,size_t align) { return Allocate(bytes,align); } // Fresh pages are zero
+      void* ReallocateZeroed(void* p,size_t oldbytes,size_t bytes,size_t align) {
+        size_t keep = MZ_min(oldbytes,bytes), committed = MZ_min(Round(oldbytes),Round(bytes)); // Only the committed part beyond the kept bytes may have old content
+        if (Reallocate(p,oldbytes,bytes,align)==nullptr) return nullptr;
+        if (committed>keep) memset(reinterpret_cast<char*>(p)+keep,0,committed-keep);
+        return p;
+      }
+      static lot_backing Backing(const void* p,size_t bytes) { return lot_hugepage<1>::Backing(p,bytes); }
+    };
+    template<size_t Reserve,size_t Commit> struct lot_inplace<lot_vmreserve<Reserve,Commit>>: true_type {};
+  #  endif
+
+    // Construction policies decide how the elements of newly reserved memory are created, and those of released memory destroyed. lot_construct_eager always runs the constructors and destructors. lot_construct_trivial (the default) skips them where they would do nothing anyway, so that no loop touches the memory, even without optimization. lot_construct_zero gets zero-filled memory from the allocation policy (calloc, fresh mmap pages), which replaces the constructor of all types for which lot_zero_constructible is true, so that reserving memory does not even fault it in. Copy assigns n elements of one lot to (constructed) elements of another, as one lot_memcpy for trivially copyable types, and Move move-assigns them.
+    template<class Tv> struct lot_zero_constructible: integral_constant<bool,is_trivially_default_constructible<Tv>::value> {};
+
+    struct lot_construct_eager {
+      static const bool zeroed = false; // Whether new memory has to be zero-filled by the allocation policy
+      template<class Tv,class Tidx> static void Construct(Tv* w,Tidx from,Tidx to) { for (Tidx i = from; i < to; i++) new(&w[i]) Tv; } // Placement new, to manually call the constructor
+      template<class Tv,class Tidx> static void Destruct(Tv* w,Tidx from,Tidx to) { for (Tidx i = from; i < to; i++) w[i].~Tv(); } // Manual call of destructor
+      template<class Tv,class Tidx> static void Copy(Tv* w,const Tv* u,Tidx n) {
+        if (is_trivially_copyable<Tv>::value) lot_memcpy(static_cast<void*>(w),u,sizeof(Tv)*n);
+        else for (Tidx i = 0; i < n; i++) w[i] = u[i];
+      }
+      template<class Tv,class Tidx> static void Move(Tv* w,Tv* u,Tidx n) { // Same as Copy, but leaves the elements of u in a moved-from state
+        if (is_trivially_copyable<Tv>::value) lot_memcpy(static_cast<void*>(w),u,sizeof(Tv)*n);
+        else for (Tidx i = 0; i < n; i++) w[i] = std::move(u[i]);
+      }
+    };
+
+    struct lot_construct_trivial: lot_construct_eager {
+      template<class Tv,class Tidx> static void Construct(Tv* w,Tidx from,Tidx to) { if (!is_trivially_default_constructible<Tv>::value) lot_construct_eager::Construct(w,from,to); }
+      template<class Tv,class Tidx> static void Destruct(Tv* w,Tidx from,Tidx to) { if (!is_trivially_destructible<Tv>::value) lot_construct_eager::Destruct(w,from,to); }
+    };
+
+    struct lot_construct_zero: lot_construct_trivial {
+      static const bool zeroed = true;
+      template<class Tv,class Tidx> static void Construct(Tv* w,Tidx from,Tidx to) { if (!lot_zero_constructible<Tv>::value) lot_construct_eager::Construct(w,from,to); }
+    };
+
+    template <class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,size_t Aalign = alignof(Tv),class Tconstruct = lot_construct_trivial,class Thooks = lot_hooks_def> class lot: protected Talloc, protected Thooks {
+      static_assert(Aalign>=alignof(Tv) && (Aalign & (Aalign-1))==0,"lot: Aalign must be a power of two, and at least alignof(Tv)");
     protected:
       class lotIt: public iterator<random_access_iterator_tag,Tv> { // Iterator
       public:
@@ -88,9 +405,11 @@ namespace std {
       //typedef random_access_iterator_tag iterator_category;
       Tidx N,cap;
       void Grow(Tidx nN) { reserve(MZ_max(nN,Tnextsize().nextsize(N))); }
+      void* Alloc(size_t bytes) { return Tconstruct::zeroed ? this->AllocateZeroed(bytes, Aalign) : this->Allocate(bytes, Aalign); }
+      void* Realloc(void* p, size_t oldbytes, size_t bytes) { return Tconstruct::zeroed ? this->ReallocateZeroed(p, oldbytes, bytes, Aalign) : this->Reallocate(p, oldbytes, bytes, Aalign); }
       inli void CopyFrom(const lot& l) {
         resize(l.size());
-        for(Tidx i = 0; i<N; i++) v[i] = l.v[i];
+        Tconstruct::Copy(v, l.v, N);
       }
       template<typename U> inli void fill_up(const U& item) { v[N-1] = item; }
     #    ifndef useCUDA
@@ -103,27 +422,52 @@ namespace std {
       Tv* v;
     public:
       typedef Tv lot_type;
+      typedef Talloc lot_alloc;
+      typedef Thooks lot_hooks_type;
+      static const size_t lot_align = Aalign;
+      static const bool lot_check = Acheck;
       // Constructors etc...
       inli ~lot() { Free(); }                                  // Default destructor
-      inli lot():N(0),cap(0) {}                                   // Default constructor
-      inli lot(Tidx startN) : cap(0),N(0) { resize(startN); }       // Constructor with initial size
-      inli lot(const lot& l) : lot() { CopyFrom(l); }                     // Copy constructor
+      inli lot():N(0),cap(0),v(nullptr) {}                                   // Default constructor
+      inli explicit lot(const Talloc& a):Talloc(a),N(0),cap(0),v(nullptr) {}         // Constructor with a (stateful) allocation policy
+      inli lot(Tidx startN,const Talloc& a = Talloc()) : Talloc(a),N(0),cap(0),v(nullptr) { resize(startN); }       // Constructor with initial size
+      inli lot(const lot& l) : lot(l.gAlloc()) { CopyFrom(l); }                     // Copy constructor
       inli lot& operator=(const lot& l) { CopyFrom(l); return *this; }   // Copy assignment
-      inli lot(lot&& l) : N(l.N),cap(l.cap),v(l.v) { l.N = 0; l.cap = 0; } // Move constructor
+      inli lot(lot&& l) : Talloc(std::move(l.gAlloc())),N(l.N),cap(l.cap),v(l.v) { // Move constructor
+        l.N = 0; l.cap = 0; l.v = nullptr;
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
+        l.OnSize(0, 0, sizeof(Tv), &lot_type_name<Tv>);
+      }
       inli lot& operator=(lot&& l) {                              // Move assignment
         std::swap(v,l.v);
         std::swap(cap,l.cap);
+        std::swap(gAlloc(),l.gAlloc()); // The memory belongs to the allocation policy
         N = l.N;
         l.N = 0;
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
+        l.OnSize(0, l.cap, sizeof(Tv), &lot_type_name<Tv>);
         return *this;
       }
-      inli lot(initializer_list<Tv> l):N(0),cap(0) {
+      inli lot(initializer_list<Tv> l,const Talloc& a = Talloc()):Talloc(a),N(0),cap(0),v(nullptr) {
         resize(static_cast<Tidx>(l.size()));
-        uninitialized_copy(l.begin(),l.end(),v); // Use placement new for initialization
+        copy(l.begin(),l.end(),v); // Elements are already constructed
       }
 
+      inli Talloc& gAlloc() { return *this; }
+      inli const Talloc& gAlloc() const { return *this; }
+      inli Thooks& gHooks() { return *this; }
+      inli const Thooks& gHooks() const { return *this; }
+
       // Element access
       inli Tv* data() { return v; }
+      inli Tv* aligned_data() { // Same as data(), but tells the compiler about the alignment, so that loops over it can use aligned vector instructions
+      #  if defined(__GNUC__)
+        return static_cast<Tv*>(__builtin_assume_aligned(v,Aalign));
+      #  else
+        __assume((reinterpret_cast<size_t>(v) & (Aalign-1))==0);
+        return v;
+      #  endif
+      }
       inli Tv& operator[] (Tidx i) const {
         if (Acheck) {
           if (i >= N) {
@@ -153,41 +497,93 @@ namespace std {
       void reserve(Tidx ncap, bool allowshrink = false) {
         ncap = MZ_max(ncap, allowshrink ? N : cap);
         if (ncap == cap) return;
+        lot_span<Thooks> span(*this, lot_op_reserve, &lot_type_name<Tv>);
+        MZ_LOT_PROBE(reserve_begin, this, cap, ncap, sizeof(Tv));
+        unsigned long long t0 = Thooks::timed ? Thooks::Now() : 0;
+        Tv* u = v;
+        Tidx oldcap = cap;
+        if (ncap < cap) Tconstruct::Destruct(v, ncap, cap);
         Tv* w;
-        if (ncap != 0) {
-          w = reinterpret_cast<Tv*>(malloc(sizeof(Tv)*ncap));
-          memcpy(&w[0], &v[0], sizeof(Tv)*MZ_min(cap,ncap));// Copy content of elements, which should be in both memory areas
-          for (Tidx i = cap; i < ncap; i++) new(&w[i]) Tv; // Placement new, to manually call the constructor
+        if (ncap == 0) {
+          if (cap != 0) this->Deallocate(v, sizeof(Tv)*cap, Aalign);
+          w = nullptr;
         }
-        else w = nullptr;
-        for (Tidx i = ncap; i < cap; i++) v[i].~Tv(); // Manual call of destructor
-        if (cap != 0) free(v);
+        else if (lot_relocatable<Tv>::value || lot_inplace<Talloc>::value) {
+          w = reinterpret_cast<Tv*>(cap != 0 ? Realloc(v, sizeof(Tv)*cap, sizeof(Tv)*ncap) : Alloc(sizeof(Tv)*ncap));
+          if (w == nullptr) throw bad_alloc();
+        }
+        else {
+          w = reinterpret_cast<Tv*>(Alloc(sizeof(Tv)*ncap));
+          if (w == nullptr) throw bad_alloc();
+          for (Tidx i = 0; i < MZ_min(cap,ncap); i++) { // Types which point into themselves have to be moved properly
+            new(&w[i]) Tv(std::move(v[i]));
+            v[i].~Tv();
+          }
+          if (cap != 0) this->Deallocate(v, sizeof(Tv)*cap, Aalign);
+        }
+        Tidx kept = MZ_min(cap,ncap);
+        if (ncap != 0) ncap = static_cast<Tidx>(MZ_min(this->Usable(w, sizeof(Tv)*ncap, Aalign)/sizeof(Tv), static_cast<size_t>(numeric_limits<Tidx>::max()))); // Claim what the allocation policy handed out beyond the request
+        if (kept < ncap) Tconstruct::Construct(w, kept, ncap);
         cap = ncap;
         v = w;
+        span.bytes = sizeof(Tv)*cap;
+        lot_reserve_event e = { &lot_type_name<Tv>, sizeof(Tv), oldcap, cap, N, w != u ? sizeof(Tv)*kept : 0, static_cast<size_t>(cap - kept), static_cast<size_t>(oldcap - kept), Thooks::timed ? Thooks::Now() - t0 : 0, MZ_RETURN_ADDRESS() };
+        MZ_LOT_PROBE(reserve_end, this, oldcap, cap, sizeof(Tv)*cap, e.copied);
+        this->OnReserve(e);
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
       }
       void shrink_to_fit() {
         reserve(N, true);
       }
 
       // Modifiers
-      inli void clear() { N = 0; }
+      inli void clear() {
+        N = 0;
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
+      }
       inli void push_back(const Tv& arg) {
         Add(arg);
       }
       inli void pop_back() {
         resize(N - 1);
       }
-      inli void resize(Tidx nN) { if (nN > cap)Grow(nN); N = nN; }
-      void swap(lot& other) {
-        swap(v, other.v);
+      inli void resize(Tidx nN) {
+        if (nN > cap)Grow(nN);
+        N = nN;
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
+      }
+      void swap(lot& other) { // Swaps the memory, including the allocation policy it belongs to, but not the hooks
+        std::swap(v, other.v);
+        std::swap(N, other.N);
+        std::swap(cap, other.cap);
+        std::swap(gAlloc(), other.gAlloc());
+        this->OnSize(N, cap, sizeof(Tv), &lot_type_name<Tv>);
+        other.OnSize(other.N, other.cap, sizeof(Tv), &lot_type_name<Tv>);
       }
 
       // More modifiers
-      void Take(lot& l) { Add(l); l.clear(); }
+      void Take(lot& l) { // Appends the elements of l and leaves l empty. When this lot is empty, or only the memory of l is large enough for both, the memory is swapped instead of growing this lot, and l gets the old memory of this lot for reuse
+        if (&l == this) return;
+        auto oldN = N, n = l.N;
+        MZ_LOT_PROBE(take, this, &l, N, n, sizeof(Tv)*n);
+        if (N == 0 || (cap < N + n && l.cap >= N + n)) {
+          swap(l);
+          if (oldN != 0) { // The old elements of this lot go in front
+            resize(n + oldN);
+            move_backward(v, v + n, v + n + oldN);
+            Tconstruct::Move(v, l.v, oldN);
+          }
+        }
+        else {
+          resize(N + n);
+          Tconstruct::Move(v + oldN, l.v, n);
+        }
+        l.clear();
+      }
       void Add(const lot& l) {
-        auto oldN = N;
-        resize(N + l.N);
-        for (Tidx i = 0; i < l.N; i++) v[oldN + i] = l[i];
+        auto oldN = N, n = l.N; // l may be this lot
+        resize(N + n);
+        Tconstruct::Copy(v + oldN, l.v, n);
       }
       inli void Add(const Tv& arg) {
         resize(N + 1);
@@ -203,10 +599,24 @@ namespace std {
         fill_up(args...);
       }
       void Free() {
+        if (cap == 0) {
+          clear();
+          return;
+        }
+        lot_span<Thooks> span(*this, lot_op_free, &lot_type_name<Tv>);
+        span.bytes = sizeof(Tv)*cap;
+        MZ_LOT_PROBE(free, this, cap, sizeof(Tv)*cap);
         clear();
         reserve(0, true);
       }
     };
+    template <class Tv,bool Acheck,class Tidx,class Tnextsize,class Talloc,size_t Aalign,class Tconstruct,class Thooks> struct lot_relocatable<lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct,Thooks>>: integral_constant<bool,lot_relocatable<Talloc>::value && lot_relocatable<Thooks>::value> {}; // A lot only points to its heap memory, so it can be moved with memcpy, unless its allocation policy or hooks can not
+    template <class Tv,bool Acheck,class Tidx,class Tnextsize,class Talloc,size_t Aalign,class Tconstruct,class Thooks> struct lot_zero_constructible<lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct,Thooks>>: integral_constant<bool,lot_zero_constructible<Talloc>::value && lot_zero_constructible<Thooks>::value> {}; // An empty lot is all zero
+
+    // Reports which kind of memory backs a lot, according to its allocation policy
+    template<class L> lot_backing lot_backing_of(L& l) {
+      return L::lot_alloc::Backing(l.data(),sizeof(typename L::lot_type)*l.capacity());
+    }
 
 
     class pu_bad_alloc: public bad_alloc {
@@ -220,21 +630,23 @@ namespace std {
     };
 
 
-    template<class Tv,class Tidx = ui32> class adapter_malloc {
+    template<class Tv,class Tidx = ui32,class Talloc = lot_malloc> class adapter_malloc: protected Talloc {
       Tv* data = nullptr;
+      size_t bytes = 0;
     public:
       void DevDestroy() {
-        free(data);
+        this->Deallocate(data,bytes,alignof(Tv));
         data = nullptr;
       }
       void DevCreate(Tidx cap) {
-        data = reinterpret_cast<Tv*>(malloc(sizeof(Tv)*cap));
+        bytes = sizeof(Tv)*cap;
+        data = reinterpret_cast<Tv*>(this->Allocate(bytes,alignof(Tv)));
       }
       void CopyDevFromHost(Tv* v,Tidx start,Tidx N) {
-        memcpy(data+start,&v[start],sizeof(Tv)*N);
+        lot_memcpy(data+start,&v[start],sizeof(Tv)*N);
       }
       void CopyHostFromDev(Tv* v,Tidx start,Tidx N) {
-        memcpy(&v[start],data+start,sizeof(Tv)*N);
+        lot_memcpy(&v[start],data+start,sizeof(Tv)*N);
       }
       bool isInit() {
         return data!=nullptr;
@@ -244,8 +656,9 @@ namespace std {
       }
     };
 
-    template<class Tv,bool Acheck = Acheck_def,class Tidx = ui32> class adapter_lot {
-      lot<Tv,Acheck> data;
+    template<class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Talloc = lot_malloc> class adapter_lot {
+      typedef lot<Tv,Acheck,Tidx,lot_nextsize<Tidx>,Talloc> dev_lot;
+      dev_lot data;
     public:
       void DevDestroy() {
         data.Free();
@@ -256,16 +669,16 @@ namespace std {
       }
       void CopyDevFromHost(Tv* v,Tidx start,Tidx N) {
         Tv* memory = data.data();
-        memcpy(memory+start,&v[start],sizeof(Tv)*N);
+        lot_memcpy(memory+start,&v[start],sizeof(Tv)*N);
       }
       void CopyHostFromDev(Tv* v,Tidx start,Tidx N) {
         Tv* memory = data.data();
-        memcpy(&v[start],memory+start,sizeof(Tv)*N);
+        lot_memcpy(&v[start],memory+start,sizeof(Tv)*N);
       }
       bool isInit() {
         return data.capacity()!=0;
       }
-      lot<Tv>& gV() {
+      dev_lot& gV() {
         return data;
       }
     };
@@ -300,17 +713,24 @@ namespace std {
     };
   #  endif
 
-    template <class DeviceAdapter,class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>> class lots: public lot<Tv,Acheck,Tidx,Tnextsize> {
+    template <class DeviceAdapter,class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,size_t Aalign = alignof(Tv),class Tconstruct = lot_construct_trivial,class Thooks = lot_hooks_def> class lots: public lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct,Thooks> {
       DeviceAdapter Adapter;
       Tidx devCap = 0;
       void DevReserve(Tidx newDevCap) {
         if(newDevCap!=devCap) {
+          lot_span<Thooks> span(*this,lot_op_dev_reserve,&lot_type_name<Tv>);
+          MZ_LOT_PROBE(dev_reserve_begin,this,devCap,newDevCap,sizeof(Tv));
           if(Adapter.isInit())Adapter.DevDestroy();
           if(newDevCap!=0)Adapter.DevCreate(newDevCap);
           if(Adapter.isInit()) devCap = newDevCap; else {
             devCap = 0;
+            MZ_LOT_PROBE(dev_reserve_end,this,devCap,static_cast<size_t>(0)); // Every begin has its end
+            this->OnDevSize(0,sizeof(Tv));
             throw pu_bad_alloc();
           }
+          span.bytes = sizeof(Tv)*devCap;
+          MZ_LOT_PROBE(dev_reserve_end,this,devCap,sizeof(Tv)*devCap);
+          this->OnDevSize(devCap,sizeof(Tv));
         }
       }
     public:
@@ -321,7 +741,11 @@ namespace std {
         DevInit();
         if(N_>this->cap) throw pu_runtime_error("lots::DevFromHost: Copy size exceeds allocated memory");
         if(devCap!=this->cap) throw pu_runtime_error("lots::DevFromHost: Device was not initialized");
+        lot_span<Thooks> span(*this,lot_op_dev_from_host,&lot_type_name<Tv>);
+        span.bytes = sizeof(Tv)*N_;
+        MZ_LOT_PROBE(dev_from_host_begin,this,start,N_,sizeof(Tv)*N_);
         Adapter.CopyDevFromHost(this->v,start,N_);
+        MZ_LOT_PROBE(dev_from_host_end,this,sizeof(Tv)*N_);
       }
       void HostFromDev(Tidx start,Tidx N_) {
         if(start>=this->cap) return;
@@ -329,7 +753,11 @@ namespace std {
         N_ = MZ_min(N_,this->cap-start);
         if(N_>this->cap) throw pu_runtime_error("lots::HostFromDev: Copy size exceeds allocated memory");
         if(devCap!=this->cap) throw pu_runtime_error("lots::HostFromDev: Device was not initialized");
-        else Adapter.CopyHostFromDev(this->v,start,N_);
+        lot_span<Thooks> span(*this,lot_op_host_from_dev,&lot_type_name<Tv>);
+        span.bytes = sizeof(Tv)*N_;
+        MZ_LOT_PROBE(host_from_dev_begin,this,start,N_,sizeof(Tv)*N_);
+        Adapter.CopyHostFromDev(this->v,start,N_);
+        MZ_LOT_PROBE(host_from_dev_end,this,sizeof(Tv)*N_);
       }
       void DevFromHost() {
         DevFromHost(0,this->N);
@@ -356,12 +784,16 @@ namespace std {
       }
       void DevFree() {
         if(Adapter.isInit()) Adapter.DevDestroy();
+        if(devCap!=0) {
+          devCap = 0; // So that DevInit creates the device memory again
+          this->OnDevSize(0,sizeof(Tv));
+        }
       }
       bool DevIsInit() {
         return Adapter.isInit();
       }
       ~lots() { DevFree(); }
-      using lot<Tv,Acheck,Tidx,Tnextsize>::lot;  // Inherits constructors of lot
+      using lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct,Thooks>::lot;  // Inherits constructors of lot
 
       //inli lots(): lot<Tv,Acheck,Tidx,Tnextsize>() {}                                   // Default constructor
       //inli lots(Tidx startN) : lot(startN) {}
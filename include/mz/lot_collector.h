@@ -0,0 +1,115 @@
+#pragma once
+
+#include "lot_parallel.h"
+#include "segmented_lot.h"
+#include <atomic>
+// "lot_collector", one lot per thread, for the common pattern in which every worker fills its own lot, and all of them are merged at the end. Add goes to the lot of the calling thread without any synchronization (each one is on its own cache lines), and gather() allocates the result once, and moves the parts of all threads into it in parallel, at offsets computed up front. The thread-local lots are either kept with their capacity for the next round, or freed. Except for Add/AddEmpty/Local, nothing may run while other threads add. The template parameters are the same as for lot.
+
+namespace std {
+  namespace mz {
+
+    // Small, dense index of the calling thread. Indices of finished threads are reused, so that per-thread tables do not grow with thread churn
+    class lot_thread_index {
+      static mutex& Lock() { static mutex* m = new mutex(); return *m; } // Never destroyed, threads may still finish at exit
+      static lot<unsigned>& Unused() { static lot<unsigned>* u = new lot<unsigned>(); return *u; }
+      struct holder {
+        unsigned i;
+        holder() {
+          static unsigned next = 0;
+          lock_guard<mutex> lk(Lock());
+          lot<unsigned>& u = Unused();
+          if (u.size() != 0) { i = u.back(); u.pop_back(); }
+          else i = next++;
+        }
+        ~holder() {
+          lock_guard<mutex> lk(Lock());
+          Unused().Add(i);
+        }
+      };
+    public:
+      static unsigned Get() {
+        static thread_local holder h;
+        return h.i;
+      }
+    };
+
+    template <class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,size_t Aalign = alignof(Tv),class Tconstruct = lot_construct_trivial> class lot_collector {
+    public:
+      typedef lot<Tv,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct> lot_t;
+    protected:
+      struct alignas(lot_cacheline) slot { lot_t l; }; // Padded, so that threads never write to the same cache line
+      segmented_lot<slot,3> slots; // Indexed by lot_thread_index. Never moves, so that threads can keep using their slot while others are added
+      atomic<unsigned> known; // Number of slots which threads can use without locking
+      mutex m;
+
+      void Register(unsigned i) {
+        lock_guard<mutex> lk(m);
+        if (i >= slots.size()) slots.resize(i+1);
+        known.store(slots.size());
+      }
+    public:
+      typedef Tv lot_type;
+      lot_collector():known(0) {}
+      lot_collector(const lot_collector&) = delete;
+      lot_collector& operator=(const lot_collector&) = delete;
+
+      // Called by the threads which collect elements
+      lot_t& Local() { // The lot of the calling thread
+        unsigned i = lot_thread_index::Get();
+        if (i >= known.load()) Register(i);
+        return slots.UncheckedAt(i).l;
+      }
+      inli void Add(const Tv& arg) { Local().Add(arg); }
+      template<typename ...Args> inli void Add(Args ...args) { Local().Add(args...); }
+      inli Tv* AddEmpty() { return Local().AddEmpty(); }
+
+      // Everything below must not be used while other threads add
+      Tidx size() const {
+        Tidx n = 0;
+        for (auto& s: slots) n = static_cast<Tidx>(n+s.l.size());
+        return n;
+      }
+      template<class F> void ForEachLocal(F f) { for (auto& s: slots) f(s.l); }
+      void gather(lot_t& out,bool keep = true) { // Appends all collected elements to out. With keep, the thread-local lots keep their memory for the next round, otherwise it is freed
+        Tidx base = out.size(), n = base;
+        unsigned full = 0;
+        lot<Tidx> at(slots.size()+1); // Offset of the part of each slot in out
+        for (Tidx s = 0; s < slots.size(); s++) {
+          at[s] = n;
+          n = static_cast<Tidx>(n+slots[s].l.size());
+          if (slots[s].l.size() != 0) full++;
+        }
+        at[slots.size()] = n;
+        if (full == 1 && base == 0 && !keep) { // A single part is simply taken over
+          for (auto& s: slots) if (s.l.size() != 0) out.Take(s.l);
+        }
+        else Move(out, base, n, at);
+        for (auto& s: slots) {
+          if (keep) s.l.clear();
+          else s.l.Free(); // Also the empty ones, and the old block of out which Take left behind
+        }
+      }
+      lot_t gather(bool keep = true) {
+        lot_t out;
+        gather(out, keep);
+        return out;
+      }
+    protected:
+      void Move(lot_t& out,Tidx base,Tidx n,const lot<Tidx>& at) { // Moves the parts to [base,n) of out, the part of slot s to at[s]
+        out.reserve(n); // Exactly, resize alone would grow by the growth policy of out
+        out.resize(n);
+        Tv* w = out.data();
+        segmented_lot<slot,3>& sl = slots;
+        lot_parallel_for(base, n, [w, &sl, &at](Tidx a, Tidx b) { // Split by elements, so that one large part is moved by all threads
+          Tidx s = static_cast<Tidx>(upper_bound(at.begin(), at.end(), a)-at.begin()-1);
+          for (; a < b; s++) {
+            Tidx e = MZ_min(b, at[s+1]);
+            if (e > a) Tconstruct::Move(w+a, sl[s].l.data()+(a-at[s]), static_cast<Tidx>(e-a));
+            a = MZ_max(a, e);
+          }
+        }, 4096);
+      }
+    };
+
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  define MZ_RETURN_ADDRESS() _ReturnAddress()
+#else
+#  define MZ_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+// Instrumentation hooks of lot and lots, the Thooks policy (the last template parameter, by default lot_hooks_def). A lot keeps its hooks as a base class and calls OnReserve after every change of its capacity, and OnSize after every change of its size or capacity (resize, clear, reserve, swap, moves), so a hook object can follow its lot without ever reading it. lots also calls OnDevSize when its device memory changes. OnBegin and OnEnd enclose the operations which may take time (a reserve which changes the capacity, Free of a lot with memory, and DevReserve, DevFromHost and HostFromDev of lots) with the bytes they allocated, released or copied. lot_nohooks does nothing and has no members, so it costs nothing at all. lot_hooks<H1,H2,...> combines several hooks. Hooks which do not need an event inherit the empty one from lot_nohooks. To instrument every lot which does not name its hooks, define lot_hooks_def (for example as lot_stats) and include the header of the hooks before lot.h.
+
+namespace std {
+  namespace mz {
+
+    // Name of a type, without RTTI. Computed once, and only when it is asked for
+    template<class Tv> const char* lot_type_name() {
+      struct name {
+        char s[256];
+        name() {
+        #  if defined(_MSC_VER)
+          const char* f = __FUNCSIG__, *a = strstr(f, "lot_type_name<");
+          size_t n = a ? strlen(a += 14) : 0;
+          n = n >= 7 ? n - 7 : 0; // Behind the type: ">(void)"
+        #  else
+          const char* f = __PRETTY_FUNCTION__, *a = strstr(f, "Tv = ");
+          size_t n = a ? strcspn(a += 5, ";]") : 0;
+        #  endif
+          if (a == nullptr) a = f;
+          n = n < sizeof(s) - 1 ? n : sizeof(s) - 1;
+          memcpy(s, a, n);
+          s[n] = 0;
+        }
+      };
+      static const name t;
+      return t.s;
+    }
+
+    struct lot_reserve_event { // One call of reserve which changed the capacity
+      const char* (*type)(); // lot_type_name of the elements
+      size_t elemSize, oldCap, newCap, N; // Capacities and size in elements
+      size_t copied; // Bytes of elements which were moved to new memory, 0 if the memory was extended in place
+      size_t constructed, destructed; // Elements of the new or released capacity
+      unsigned long long ns; // Duration, 0 unless the hooks are timed
+      const void* caller; // Return address of reserve, in the code which called it (or in Grow, if that was not inlined)
+    };
+
+    enum lot_op { lot_op_reserve, lot_op_free, lot_op_dev_reserve, lot_op_dev_from_host, lot_op_host_from_dev };
+    inline const char* lot_op_name(lot_op o) {
+      static const char* const names[] = { "reserve", "Free", "DevReserve", "DevFromHost", "HostFromDev" };
+      return names[o];
+    }
+
+    template<class... Th> struct lot_hooks;
+    template<> struct lot_hooks<> {
+      static const bool timed = false; // Whether lot measures the duration of reserve with Now
+      static unsigned long long Now() { return 0; }
+      void OnReserve(const lot_reserve_event&) {}
+      void OnSize(size_t /*N*/,size_t /*cap*/,size_t /*elemSize*/,const char* (* /*type*/)()) {}
+      void OnDevSize(size_t /*devCap*/,size_t /*elemSize*/) {} // Device capacity of lots, in elements
+      void OnBegin(lot_op,const char* (* /*type*/)()) {}
+      void OnEnd(lot_op,size_t /*bytes*/) {} // New capacity (reserve, DevReserve), released capacity (Free) or copied bytes (DevFromHost, HostFromDev)
+    };
+    typedef lot_hooks<> lot_nohooks;
+
+    template<class H> struct lot_hooks<H>: H {};
+    template<class H,class H2,class... Th> struct lot_hooks<H,H2,Th...>: H, lot_hooks<H2,Th...> { // Calls every hook, in order
+      typedef lot_hooks<H2,Th...> rest;
+      static const bool timed = H::timed || rest::timed;
+      static unsigned long long Now() { return H::timed ? H::Now() : rest::Now(); }
+      void OnReserve(const lot_reserve_event& e) {
+        H::OnReserve(e);
+        rest::OnReserve(e);
+      }
+      void OnSize(size_t N,size_t cap,size_t elemSize,const char* (*type)()) {
+        H::OnSize(N, cap, elemSize, type);
+        rest::OnSize(N, cap, elemSize, type);
+      }
+      void OnDevSize(size_t devCap,size_t elemSize) {
+        H::OnDevSize(devCap, elemSize);
+        rest::OnDevSize(devCap, elemSize);
+      }
+      void OnBegin(lot_op op,const char* (*type)()) {
+        H::OnBegin(op, type);
+        rest::OnBegin(op, type);
+      }
+      void OnEnd(lot_op op,size_t bytes) { // In reverse order, so that the spans of the hooks nest
+        rest::OnEnd(op, bytes);
+        H::OnEnd(op, bytes);
+      }
+    };
+
+    template<class H> class lot_span { // Calls OnBegin, and OnEnd when the scope ends, also by an exception
+    public:
+      size_t bytes;
+      lot_span(H& h_,lot_op op_,const char* (*type)()):bytes(0),h(h_),op(op_) { h.OnBegin(op, type); }
+      ~lot_span() { h.OnEnd(op, bytes); }
+      lot_span(const lot_span&) = delete;
+      lot_span& operator=(const lot_span&) = delete;
+    private:
+      H& h;
+      lot_op op;
+    };
+
+  }
+}
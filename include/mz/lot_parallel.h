@@ -0,0 +1,202 @@
+#pragma once
+
+#include "segmented_lot.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+// Parallel construction, destruction and copying of lot elements. lot_construct_parallel is a construction policy (see lot_construct_trivial) which splits the constructor and destructor loops of reserve and Free, and the bulk copies and moves of copy assignment, Add and Take, across the threads of lot_pool, once a range has at least Athreshold elements. Copies of trivially copyable types of at least Astream_def bytes use non-temporal stores in every thread. The range is cut into one static chunk per thread, and chunk t always goes to the same thread t, so that with Afirsttouch (or with constructors which write to the memory) every page is placed on the NUMA node of the thread which touched it first. Loops over the lot which use lot_parallel_for with the same range then work on local memory. Needs linking with the thread library (Threads::Threads).
+
+namespace std {
+  namespace mz {
+
+    static const size_t lot_cacheline = 64;
+
+    class lot_pool {
+      vector<thread> workers;
+      mutex m,busy; // busy is held by the caller of a running loop, so that only one loop at a time uses the workers
+      condition_variable wake,done;
+      const function<void(unsigned)>* job = nullptr;
+      unsigned jobthreads = 0, pending = 0;
+      ui64 generation = 0;
+      bool stop = false;
+      exception_ptr error;
+
+      static bool& InWorker() { static thread_local bool w = false; return w; } // Whether this thread runs a loop body, as a worker or as the caller of Run
+      void Call(unsigned t) {
+        try { (*job)(t); }
+        catch (...) {
+          lock_guard<mutex> lk(m);
+          if (!error) error = current_exception();
+        }
+      }
+      void Work(unsigned t) {
+        InWorker() = true;
+        ui64 seen = 0;
+        unique_lock<mutex> lk(m);
+        for (;;) {
+          wake.wait(lk, [&] { return generation != seen || stop; });
+          if (stop) return;
+          seen = generation;
+          if (t >= jobthreads) continue;
+          lk.unlock();
+          Call(t);
+          lk.lock();
+          if (--pending == 0) done.notify_one();
+        }
+      }
+    public:
+      explicit lot_pool(unsigned threads) {
+        for (unsigned t = 1; t < threads; t++) workers.emplace_back(&lot_pool::Work, this, t);
+      }
+      ~lot_pool() {
+        {
+          lock_guard<mutex> lk(m);
+          stop = true;
+        }
+        wake.notify_all();
+        for (auto& w: workers) w.join();
+      }
+      lot_pool(const lot_pool&) = delete;
+      lot_pool& operator=(const lot_pool&) = delete;
+      static lot_pool& Get() { // Never destroyed, because lots with static storage duration may still need it at exit
+        static lot_pool* pool = new lot_pool(MZ_max(1u, thread::hardware_concurrency()));
+        return *pool;
+      }
+      unsigned Threads() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+      // Calls f(t) for every t < threads (at most Threads()), each on its own thread, t == 0 on the calling thread. Runs serially when called from inside a loop, or while another thread runs one, so that nested parallel construction (lot<lot<Tv>>) cannot deadlock. The first exception is rethrown after all threads finished.
+      void Run(unsigned threads, const function<void(unsigned)>& f) {
+        threads = MZ_min(threads, Threads());
+        if (threads <= 1 || InWorker()) { // Before busy, which a nested loop of the caller already owns
+          for (unsigned t = 0; t < threads; t++) f(t);
+          return;
+        }
+        unique_lock<mutex> owner(busy, try_to_lock);
+        if (!owner.owns_lock()) {
+          for (unsigned t = 0; t < threads; t++) f(t);
+          return;
+        }
+        {
+          lock_guard<mutex> lk(m);
+          job = &f;
+          jobthreads = threads;
+          pending = threads - 1;
+          error = nullptr;
+          generation++;
+        }
+        wake.notify_all();
+        InWorker() = true;
+        Call(0);
+        InWorker() = false;
+        unique_lock<mutex> lk(m);
+        done.wait(lk, [&] { return pending == 0; });
+        job = nullptr;
+        if (error) rethrow_exception(error);
+      }
+
+      // Splits [from,to) into one static chunk per thread, and calls f(a,b) for each chunk [a,b). Chunks have at least minchunk elements, so small ranges use fewer threads
+      template<class Tidx,class F> void For(Tidx from, Tidx to, size_t minchunk, F f) {
+        size_t n = to > from ? static_cast<size_t>(to - from) : 0;
+        unsigned threads = static_cast<unsigned>(MZ_min(static_cast<size_t>(Threads()), MZ_max(n / MZ_max(minchunk, size_t(1)), size_t(1))));
+        Run(threads, [&](unsigned t) {
+          Tidx a = static_cast<Tidx>(from + n * t / threads);
+          Tidx b = static_cast<Tidx>(from + n * (t + 1) / threads);
+          if (a < b) f(a, b);
+        });
+      }
+
+      // Calls f(a,b) for adaptive chunks of [from,to), for irregular work. Every thread starts on its own static part, and takes chunks of a shrinking size (half of what is left, divided by the number of threads, but at least grain) from its front. A thread which runs out steals the back half of the remaining part of another thread.
+      template<class Tidx,class F> void ForDynamic(Tidx from, Tidx to, size_t grain, F f) {
+        size_t n = to > from ? static_cast<size_t>(to - from) : 0;
+        grain = MZ_max(grain, size_t(1));
+        unsigned threads = static_cast<unsigned>(MZ_min(static_cast<size_t>(Threads()), MZ_max(n / grain, size_t(1))));
+        struct alignas(lot_cacheline) part { mutex m; size_t a, b; }; // Remaining part of one thread
+        segmented_lot<part> parts(threads); // Never moves its elements, like the mutexes need
+        for (unsigned t = 0; t < threads; t++) {
+          parts[t].a = n * t / threads;
+          parts[t].b = n * (t + 1) / threads;
+        }
+        Run(threads, [&](unsigned t) {
+          part& own = parts[t];
+          for (;;) {
+            size_t a = 0, b = 0;
+            {
+              lock_guard<mutex> lk(own.m);
+              if (own.a < own.b) {
+                a = own.a;
+                b = own.b;
+                b = MZ_min(b, a + MZ_max(grain, (b - a) / (2 * threads)));
+                own.a = b;
+              }
+            }
+            if (a < b) {
+              f(static_cast<Tidx>(from + a), static_cast<Tidx>(from + b));
+              continue;
+            }
+            for (unsigned k = 1; k < threads && a == b; k++) { // Steal, without holding two locks at once
+              part& victim = parts[(t + k) % threads];
+              lock_guard<mutex> lk(victim.m);
+              if (victim.b - victim.a > grain) {
+                a = victim.a + (victim.b - victim.a) / 2;
+                b = victim.b;
+                victim.b = a;
+              }
+            }
+            if (a == b) return; // Whatever is left is already owned by a running thread
+            lock_guard<mutex> lk(own.m);
+            own.a = a;
+            own.b = b;
+          }
+        });
+      }
+    };
+
+    // Same chunking as the parallel construction policy, for loops over a lot which should run on the memory placed there by first touch
+    template<class Tidx,class F> inline void lot_parallel_for(Tidx from, Tidx to, F f, size_t minchunk = 1) { lot_pool::Get().For(from, to, minchunk, f); }
+
+    // Calls f(x,i) for the elements x = l[i] of a lot (or small_lot, segmented_lot) in parallel, with work stealing between adaptive chunks of at least grain elements, like for_lot_x. parallel_for_ab does the same for [i1,i2). Lots with Acheck throw out_of_range for a range beyond size(), others clamp it like for_lot_ab. Loops inside f run serially, so nesting does not oversubscribe the threads.
+    template<class L,class F> void parallel_for_ab(L& l, decltype(declval<L&>().size()) i1, decltype(declval<L&>().size()) i2, F f, size_t grain = 1) {
+      typedef decltype(l.size()) Tidx;
+      if (L::lot_check && (i1 > i2 || i2 > l.size())) throw out_of_range("parallel_for_ab: Range exceeds the lot!\n");
+      i2 = MZ_min(i2, l.size());
+      if (i1 >= i2) return;
+      lot_pool::Get().ForDynamic(i1, i2, grain, [&l, &f](Tidx a, Tidx b) { for (Tidx i = a; i < b; i++) f(l.UncheckedAt(i), i); });
+    }
+    template<class L,class F> void parallel_for(L& l, F f, size_t grain = 1) { parallel_for_ab(l, 0, l.size(), f, grain); }
+
+    template<size_t Athreshold = (1 << 15),class Tbase = lot_construct_trivial,bool Afirsttouch = false> struct lot_construct_parallel: Tbase {
+      static const bool zeroed = Tbase::zeroed;
+      template<class Tv,class Tidx> static void Construct(Tv* w, Tidx from, Tidx to) {
+        if ((!Afirsttouch && is_trivially_default_constructible<Tv>::value) || static_cast<size_t>(to - from) < Athreshold) return Tbase::Construct(w, from, to); // Nothing to do in parallel
+        lot_pool::Get().For(from, to, Athreshold / 8, [w](Tidx a, Tidx b) {
+          if (Afirsttouch) memset(static_cast<void*>(w + a), 0, sizeof(Tv)*(b - a)); // Also for types whose construction does not write anything
+          Tbase::Construct(w, a, b);
+        });
+      }
+      template<class Tv,class Tidx> static void Destruct(Tv* w, Tidx from, Tidx to) {
+        if (is_trivially_destructible<Tv>::value || static_cast<size_t>(to - from) < Athreshold) return Tbase::Destruct(w, from, to);
+        lot_pool::Get().For(from, to, Athreshold / 8, [w](Tidx a, Tidx b) { Tbase::Destruct(w, a, b); });
+      }
+      template<class Tv,class Tidx> static void Copy(Tv* w, const Tv* u, Tidx n) {
+        if (static_cast<size_t>(n) < Athreshold) return Tbase::Copy(w, u, n);
+        Split(w, u, n, [](Tv* wa, const Tv* ua, Tidx na) { Tbase::Copy(wa, ua, na); });
+      }
+      template<class Tv,class Tidx> static void Move(Tv* w, Tv* u, Tidx n) {
+        if (static_cast<size_t>(n) < Athreshold) return Tbase::Move(w, u, n);
+        Split(w, u, n, [](Tv* wa, Tv* ua, Tidx na) { Tbase::Move(wa, ua, na); });
+      }
+    private:
+      template<class Tv,class Tu,class Tidx,class F> static void Split(Tv* w, Tu* u, Tidx n, F f) {
+        bool stream = is_trivially_copyable<Tv>::value && sizeof(Tv)*n >= Astream_def; // Decided for the whole copy, the chunks are smaller
+        lot_pool::Get().For(Tidx(0), n, Athreshold / 8, [w, u, stream, &f](Tidx a, Tidx b) {
+          if (stream) lot_memcpy_stream(static_cast<void*>(w + a), u + a, sizeof(Tv)*(b - a));
+          else f(w + a, u + a, static_cast<Tidx>(b - a));
+        });
+      }
+    };
+
+  }
+}
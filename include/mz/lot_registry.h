@@ -0,0 +1,217 @@
+#pragma once
+
+#include "lot_hooks.h"
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#include <cstring>
+// "lot_registered", hooks which enter every living lot with memory into a global registry: its element type, size, capacity, device capacity (of lots) and an optional tag. lot_registry::Snapshot sums them up, and lists the lots and the groups of lots (same type and tag) with the most bytes, so that memory which hides as slack after clear() can be attributed. A lot is only registered while it has memory, and the registry is split into shards with their own mutex, so concurrent construction and destruction rarely wait; sizes are relaxed atomics, which a snapshot reads without stopping the lots. To register every lot, define lot_hooks_def as lot_registered and include this header before lot.h.
+
+namespace std {
+  namespace mz {
+
+    class lot_registry;
+
+    struct lot_registered: lot_nohooks {
+      lot_registered():N(0),cap(0),devCap(0),tag(nullptr),type(nullptr),elemSize(0),prev(nullptr),next(nullptr),shard(0),linked(false) {}
+      lot_registered(const lot_registered&):lot_registered() {} // A copied lot is another lot
+      lot_registered& operator=(const lot_registered&) { return *this; }
+      ~lot_registered() { Unlink(); }
+
+      void OnSize(size_t n,size_t c,size_t es,const char* (*t)()) {
+        if (!linked && c != 0) Link(es);
+        type.store(t, memory_order_relaxed);
+        N.store(n, memory_order_relaxed);
+        cap.store(c, memory_order_relaxed);
+        if (c == 0 && devCap.load(memory_order_relaxed) == 0) Unlink();
+      }
+      void OnDevSize(size_t d,size_t es) {
+        if (!linked && d != 0) Link(es);
+        devCap.store(d, memory_order_relaxed);
+        if (d == 0 && cap.load(memory_order_relaxed) == 0) Unlink();
+      }
+      void Tag(const char* t) { tag.store(t, memory_order_relaxed); } // Shown in snapshots, t has to live as long as the lot
+      const char* gTag() const { return tag.load(memory_order_relaxed); }
+    private:
+      friend class lot_registry;
+      atomic<size_t> N, cap, devCap;
+      atomic<const char*> tag;
+      atomic<const char* (*)()> type;
+      size_t elemSize;
+      lot_registered *prev, *next; // In the list of the shard
+      unsigned shard;
+      bool linked;
+      void Link(size_t es);
+      void Unlink();
+    };
+
+    class lot_registry {
+    public:
+      struct entry { // One lot, or in groups, the sum of all lots with the same type and tag
+        const char* type;
+        const char* tag;
+        size_t lots, N, capacity, elemSize, devCapacity;
+        size_t Bytes() const { return capacity*elemSize; }
+        size_t SlackBytes() const { return (capacity - N)*elemSize; }
+        size_t DevBytes() const { return devCapacity*elemSize; }
+      };
+      typedef vector<entry> entries;
+      struct snapshot {
+        size_t lots, bytes, usedBytes, slackBytes, devBytes;
+        entries top, groups; // By Bytes, at most topN
+        string Json() const {
+          char buf[256];
+          snprintf(buf, sizeof(buf), "{\"time\":%lld,\"lots\":%zu,\"bytes\":%zu,\"usedBytes\":%zu,\"slackBytes\":%zu,\"devBytes\":%zu,\"top\":[", static_cast<long long>(chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count()), lots, bytes, usedBytes, slackBytes, devBytes);
+          string out = buf;
+          List(out, top);
+          out += "],\"groups\":[";
+          List(out, groups);
+          out += "]}";
+          return out;
+        }
+      private:
+        static void Quoted(string& out,const char* s) {
+          out += '"';
+          for (; s != nullptr && *s; s++) {
+            if (*s == '"' || *s == '\\') out += '\\';
+            out += *s;
+          }
+          out += '"';
+        }
+        static void List(string& out,const entries& l) {
+          char buf[256];
+          for (size_t i = 0; i < l.size(); i++) {
+            const entry& e = l[i];
+            out += i ? ",{\"type\":" : "{\"type\":";
+            Quoted(out, e.type);
+            out += ",\"tag\":";
+            Quoted(out, e.tag);
+            snprintf(buf, sizeof(buf), ",\"lots\":%zu,\"size\":%zu,\"capacity\":%zu,\"bytes\":%zu,\"slackBytes\":%zu,\"devBytes\":%zu}", e.lots, e.N, e.capacity, e.Bytes(), e.SlackBytes(), e.DevBytes());
+            out += buf;
+          }
+        }
+      };
+
+      static snapshot Snapshot(size_t topN = 10) {
+        snapshot s;
+        s.lots = s.bytes = s.usedBytes = s.slackBytes = s.devBytes = 0;
+        entries all;
+        for (unsigned k = 0; k < shards; k++) {
+          lock_guard<mutex> lock(Shards()[k].m);
+          for (lot_registered* r = Shards()[k].head; r != nullptr; r = r->next) {
+            const char* (*t)() = r->type.load(memory_order_relaxed);
+            entry e = { t ? t() : "?", r->gTag(), 1, r->N.load(memory_order_relaxed), r->cap.load(memory_order_relaxed), r->elemSize, r->devCap.load(memory_order_relaxed) };
+            e.N = min(e.N, e.capacity); // Both are read while the lot may change
+            all.push_back(e);
+          }
+        }
+        for (const entry& e: all) {
+          s.lots++;
+          s.bytes += e.Bytes();
+          s.usedBytes += e.N*e.elemSize;
+          s.slackBytes += e.SlackBytes();
+          s.devBytes += e.DevBytes();
+        }
+        auto bigger = [](const entry& a,const entry& b) { return a.Bytes() + a.DevBytes() > b.Bytes() + b.DevBytes(); };
+        sort(all.begin(), all.end(), [](const entry& a,const entry& b) { int c = Compare(a.type, b.type); return c ? c < 0 : Compare(a.tag, b.tag) < 0; });
+        for (const entry& e: all) { // Sums up the runs of the same type and tag, lots with different element sizes count as bytes of 1 byte elements
+          if (s.groups.size() != 0 && Compare(s.groups.back().type, e.type) == 0 && Compare(s.groups.back().tag, e.tag) == 0) {
+            entry& g = s.groups.back();
+            if (g.elemSize != e.elemSize) g = entry{ g.type, g.tag, g.lots, g.N*g.elemSize, g.capacity*g.elemSize, 1, g.devCapacity*g.elemSize };
+            g.lots++;
+            g.N += e.N*e.elemSize/g.elemSize;
+            g.capacity += e.capacity*e.elemSize/g.elemSize;
+            g.devCapacity += e.devCapacity*e.elemSize/g.elemSize;
+          }
+          else s.groups.push_back(e);
+        }
+        Top(all, bigger, topN);
+        Top(s.groups, bigger, topN);
+        s.top.swap(all);
+        return s;
+      }
+      static bool Dump(const char* path,size_t topN = 10,bool append = true) { // Writes a snapshot as one line of JSON
+        FILE* f = fopen(path, append ? "a" : "w");
+        if (f == nullptr) return false;
+        string j = Snapshot(topN).Json() + "\n";
+        bool ok = fwrite(j.data(), 1, j.size(), f) == j.size();
+        return fclose(f) == 0 && ok;
+      }
+      static void StartDumps(const char* path,unsigned ms,size_t topN = 10) { // Appends a snapshot to the file every ms milliseconds, on a background thread
+        StopDumps();
+        dumper& d = Dumper();
+        lock_guard<mutex> lock(d.m);
+        d.stop = false;
+        string p = path;
+        d.t = thread([p,ms,topN]() {
+          dumper& w = Dumper();
+          unique_lock<mutex> l(w.m);
+          while (!w.cv.wait_for(l, chrono::milliseconds(ms), [&w]() { return w.stop; })) {
+            l.unlock();
+            Dump(p.c_str(), topN);
+            l.lock();
+          }
+        });
+      }
+      static void StopDumps() {
+        dumper& d = Dumper();
+        {
+          lock_guard<mutex> lock(d.m);
+          d.stop = true;
+        }
+        d.cv.notify_all();
+        if (d.t.joinable()) d.t.join();
+      }
+    private:
+      friend struct lot_registered;
+      static const unsigned shards = 16;
+      struct shard {
+        mutex m;
+        lot_registered* head;
+        shard():head(nullptr) {}
+      };
+      struct dumper {
+        mutex m;
+        condition_variable cv;
+        thread t;
+        bool stop;
+      };
+      static shard* Shards() { static shard* s = new shard[shards]; return s; } // Never destroyed, so that static lots can still unregister on exit
+      static dumper& Dumper() { static dumper* d = new dumper(); return *d; }
+      static int Compare(const char* a,const char* b) { return a == b ? 0 : a == nullptr ? -1 : b == nullptr ? 1 : strcmp(a, b); }
+      template<class F> static void Top(entries& l,F bigger,size_t n) {
+        n = min(n, l.size());
+        partial_sort(l.begin(), l.begin() + static_cast<ptrdiff_t>(n), l.end(), bigger);
+        l.resize(n);
+      }
+    };
+
+    inline void lot_registered::Link(size_t es) {
+      elemSize = es;
+      shard = static_cast<unsigned>((reinterpret_cast<size_t>(this) >> 6) % lot_registry::shards);
+      lot_registry::shard& s = lot_registry::Shards()[shard];
+      lock_guard<mutex> lock(s.m);
+      prev = nullptr;
+      next = s.head;
+      if (next != nullptr) next->prev = this;
+      s.head = this;
+      linked = true;
+    }
+    inline void lot_registered::Unlink() {
+      if (!linked) return;
+      lot_registry::shard& s = lot_registry::Shards()[shard];
+      lock_guard<mutex> lock(s.m);
+      if (prev != nullptr) prev->next = next; else s.head = next;
+      if (next != nullptr) next->prev = prev;
+      prev = next = nullptr;
+      linked = false;
+    }
+
+  }
+}
@@ -0,0 +1,587 @@
+#pragma once
+
+#include "lot.h"
+// Vectorized kernels for lots (and raw arrays) of float, double, int32_t and ui32: Fill, Iota, Axpy, Scale, Add/Sub/Mul, Sum (pairwise or Kahan), Dot, Min/Max, ArgMin/ArgMax, Count, Find and Clamp. Every kernel works on a fixed number of independent lanes (accumulators). On x86 with GCC/clang, it is written with the vector extension of the compilers, so that it does not depend on the auto-vectorizer or the optimization flags, and compiled once for each instruction set (SSE2, AVX2, AVX-512, with target attributes); the simd_codegen test checks the code of these entry points. A plain loop over the same lanes, without a target, is the fallback. lot_simd picks the best one the CPU supports at runtime. Floating point results may differ in the last bits between the instruction sets, because the number of lanes changes the order of the additions, and because compilers may fuse a*x+y into FMA for AVX-512 (GCC does, unless -ffp-contract=off). NaNs are not supported by Min/Max/ArgMin/ArgMax. The lot versions work with lot and small_lot, and for two lots, they throw length_error for different sizes if the lot has Acheck, and use the smaller size otherwise.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define MZ_SIMD_X86 1
+#  define MZ_SIMD_SSE2 __attribute__((target("sse2")))
+#  define MZ_SIMD_AVX2 __attribute__((target("avx2")))
+#  if defined(__clang__)
+#    define MZ_SIMD_AVX512 __attribute__((target("avx512f,avx512dq")))
+#  else
+#    define MZ_SIMD_AVX512 __attribute__((target("avx512f,avx512dq,prefer-vector-width=512")))
+#  endif
+#else
+#  define MZ_SIMD_X86 0
+#endif
+
+namespace std {
+  namespace mz {
+
+    template<class T> struct lot_simd_acc { typedef T type; }; // Type of Sum and Dot, wide enough for the integer types
+    template<> struct lot_simd_acc<int32_t> { typedef int64_t type; };
+    template<> struct lot_simd_acc<ui32> { typedef ui64 type; };
+    template<class T> struct lot_simd_same { typedef T type; }; // So that scalar arguments do not take part in the deduction of T
+    template<class T,size_t Avector> struct lot_simd_vec { static const bool on = false; }; // A vector register of T, with the vector extension of GCC and clang
+  #if MZ_SIMD_X86
+  #  define MZ_SIMD_VEC(T) \
+    template<> struct lot_simd_vec<T,16> { static const bool on = true; typedef T type __attribute__((vector_size(16))); }; \
+    template<> struct lot_simd_vec<T,32> { static const bool on = true; typedef T type __attribute__((vector_size(32))); }; \
+    template<> struct lot_simd_vec<T,64> { static const bool on = true; typedef T type __attribute__((vector_size(64))); };
+    MZ_SIMD_VEC(float) MZ_SIMD_VEC(double) MZ_SIMD_VEC(int32_t) MZ_SIMD_VEC(ui32) MZ_SIMD_VEC(int64_t) MZ_SIMD_VEC(ui64)
+  #  undef MZ_SIMD_VEC
+  #endif
+
+    // The kernels for L lanes (a power of 2), in 4 registers of Avector bytes (0 for the fallback). Everything is always inlined into the entry points of each instruction set below. With a vector register type, the lanes are 4 vector variables, with the same order of operations as the plain loops (which handle the rest at the end); only the integer sums, which are exact, add the even and odd elements in separate 64 bit lanes
+    template<class T,size_t L,size_t Avector> struct lot_simd_kernels {
+      static_assert(is_arithmetic<T>::value,"lot_simd: Only for arithmetic types");
+      typedef typename lot_simd_acc<T>::type acc;
+      typedef typename conditional<sizeof(T) == 8,ui64,ui32>::type counter; // Same width as T, so that the comparisons vectorize
+      typedef integral_constant<bool,lot_simd_vec<T,Avector>::on> vectors;
+      typedef integral_constant<int,!vectors::value ? 0 : is_same<acc,T>::value ? 1 : 2> vector_sums; // 1 for the same type, 2 for 32 bit integers in 64 bit sums
+      static const size_t W = L/4; // Lanes per register
+      // Vectors are passed by reference only, so that the ABI of functions without a target does not matter
+      template<class V> static inli void Load(V& v, const T* p) { memcpy(&v, p, sizeof(V)); } // Unaligned
+      template<class V> static inli void Store(T* p, const V& v) { memcpy(p, &v, sizeof(V)); }
+      template<class A> static inli void Widen(A& even, A& odd, const T* p) { // 2*sizeof(A)/sizeof(T) elements of 32 bits, sign or zero extended to the type of A
+        typedef typename lot_simd_vec<ui64,Avector>::type U;
+        U u, e;
+        Load(u, p);
+        e = u << 32;
+        memcpy(&even, &e, sizeof(A));
+        memcpy(&odd, &u, sizeof(A));
+        even >>= 32;
+        odd >>= 32;
+      }
+      template<class V> static inli void Splat(V& v, T x) {
+        T a[W];
+        for (size_t j = 0; j < W; j++) a[j] = x;
+        memcpy(&v, a, sizeof(V));
+      }
+      template<class V,class M> static inli void Pick(V& v, const V& x, const M& m) { // v = m ? x : v, in every lane
+        M a, b;
+        memcpy(&a, &x, sizeof(M));
+        memcpy(&b, &v, sizeof(M));
+        a = (a & m) | (b & ~m);
+        memcpy(&v, &a, sizeof(M));
+      }
+      struct load1 {
+        const T* p;
+        inli acc operator()(size_t i) const { return static_cast<acc>(p[i]); }
+        template<class V> inli void operator()(V& s, size_t i) const { V x; Load(x, p+i); s += x; }
+        template<class A> inli void Wide(A& s, size_t i) const { A e, o; Widen(e, o, p+i); s += e + o; }
+      };
+      struct load2 {
+        const T *a,*b;
+        inli acc operator()(size_t i) const { return static_cast<acc>(a[i])*static_cast<acc>(b[i]); }
+        template<class V> inli void operator()(V& s, size_t i) const { V x, y; Load(x, a+i); Load(y, b+i); s += x*y; }
+        template<class A> inli void Wide(A& s, size_t i) const { A ea, oa, eb, ob; Widen(ea, oa, a+i); Widen(eb, ob, b+i); s += ea*eb + oa*ob; }
+      };
+
+      template<class F> static inli acc Lanes(size_t from, size_t to, F f) { return Lanes(from, to, f, vector_sums()); } // Sum of f(i) over [from,to), in L accumulators
+      template<class F> static inli acc Lanes(size_t from, size_t to, F f, integral_constant<int,0>) {
+        acc s[L] = {};
+        size_t i = from;
+        for (; i + L <= to; i += L) for (size_t j = 0; j < L; j++) s[j] += f(i+j);
+        return LanesEnd(s, i, to, f);
+      }
+      template<class F> static inli acc Lanes(size_t from, size_t to, F f, integral_constant<int,1>) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V s0 = {}, s1 = {}, s2 = {}, s3 = {};
+        size_t i = from;
+        for (; i + L <= to; i += L) {
+          f(s0, i);
+          f(s1, i+W);
+          f(s2, i+2*W);
+          f(s3, i+3*W);
+        }
+        acc s[L];
+        memcpy(s, &s0, sizeof(V));
+        memcpy(s+W, &s1, sizeof(V));
+        memcpy(s+2*W, &s2, sizeof(V));
+        memcpy(s+3*W, &s3, sizeof(V));
+        return LanesEnd(s, i, to, f);
+      }
+      template<class F> static inli acc Lanes(size_t from, size_t to, F f, integral_constant<int,2>) {
+        typedef typename lot_simd_vec<acc,Avector>::type A;
+        A s0 = {}, s1 = {}, s2 = {}, s3 = {};
+        size_t i = from;
+        for (; i + L <= to; i += L) {
+          f.Wide(s0, i);
+          f.Wide(s1, i+W);
+          f.Wide(s2, i+2*W);
+          f.Wide(s3, i+3*W);
+        }
+        s0 += s1 + s2 + s3;
+        acc s[L] = {}, a[W/2];
+        memcpy(a, &s0, sizeof(A));
+        for (size_t j = 0; j < W/2; j++) s[0] += a[j];
+        return LanesEnd(s, i, to, f);
+      }
+      template<class F> static inli acc LanesEnd(acc* s, size_t i, size_t to, F f) { // The rest, and the lanes added pairwise
+        for (size_t j = 0; i + j < to; j++) s[j] += f(i+j);
+        for (size_t h = L/2; h > 0; h /= 2) for (size_t j = 0; j < h; j++) s[j] += s[j+h];
+        return s[0];
+      }
+      template<class F> static inli acc Pairwise(size_t n, F f) { // Blocks of 64*L elements, whose sums are added pairwise, with a stack like a binary counter
+        const size_t B = 64*L;
+        acc stack[64];
+        unsigned top = 0;
+        size_t k = 0;
+        for (size_t i = 0; i < n; i += B, k++) {
+          stack[top++] = Lanes(i, MZ_min(n, i+B), f);
+          for (size_t c = k; c & 1; c >>= 1) { top--; stack[top-1] += stack[top]; }
+        }
+        acc s = 0;
+        while (top != 0) s += stack[--top];
+        return s;
+      }
+
+      static inli void Fill(T* w, size_t n, T x) { Fill(w, n, x, vectors()); }
+      static inli void Fill(T* w, size_t n, T x, false_type) { for (size_t i = 0; i < n; i++) w[i] = x; }
+      static inli void Fill(T* w, size_t n, T x, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V v;
+        Splat(v, x);
+        size_t i = 0;
+        for (; i + W <= n; i += W) Store(w+i, v);
+        Fill(w+i, n-i, x, false_type());
+      }
+      static inli void Iota(T* w, size_t n, T start, T step) { Iota(w, n, start, step, vectors()); }
+      static inli void Iota(T* w, size_t n, T start, T step, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        T lane[W];
+        for (size_t j = 0; j < W; j++) lane[j] = static_cast<T>(j);
+        V l, b, vs, vd, x;
+        Load(l, lane);
+        Splat(vs, start);
+        Splat(vd, step);
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+          Splat(b, static_cast<T>(i));
+          x = vs + (b + l)*vd;
+          Store(w+i, x);
+        }
+        for (; i < n; i++) w[i] = static_cast<T>(start + static_cast<T>(i)*step);
+      }
+      static inli void Iota(T* w, size_t n, T start, T step, false_type) {
+        T lane[L];
+        for (size_t j = 0; j < L; j++) lane[j] = static_cast<T>(j);
+        size_t i = 0;
+        for (; i + L <= n; i += L) {
+          T b = static_cast<T>(i);
+          for (size_t j = 0; j < L; j++) w[i+j] = static_cast<T>(start + (b + lane[j])*step);
+        }
+        for (; i < n; i++) w[i] = static_cast<T>(start + static_cast<T>(i)*step);
+      }
+      static inli void Axpy(T* y, const T* x, size_t n, T a) { Axpy(y, x, n, a, vectors()); }
+      static inli void Axpy(T* y, const T* x, size_t n, T a, false_type) { for (size_t i = 0; i < n; i++) y[i] = static_cast<T>(y[i] + a*x[i]); }
+      static inli void Axpy(T* y, const T* x, size_t n, T a, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V va, vx, vy;
+        Splat(va, a);
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+          Load(vx, x+i);
+          Load(vy, y+i);
+          vy += va*vx;
+          Store(y+i, vy);
+        }
+        Axpy(y+i, x+i, n-i, a, false_type());
+      }
+      static inli void Scale(T* w, size_t n, T a) { Scale(w, n, a, vectors()); }
+      static inli void Scale(T* w, size_t n, T a, false_type) { for (size_t i = 0; i < n; i++) w[i] = static_cast<T>(w[i]*a); }
+      static inli void Scale(T* w, size_t n, T a, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V va, x;
+        Splat(va, a);
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+          Load(x, w+i);
+          x *= va;
+          Store(w+i, x);
+        }
+        Scale(w+i, n-i, a, false_type());
+      }
+      struct add { template<class U> inli void operator()(U& a, const U& b) const { a = static_cast<U>(a + b); } };
+      struct sub { template<class U> inli void operator()(U& a, const U& b) const { a = static_cast<U>(a - b); } };
+      struct mul { template<class U> inli void operator()(U& a, const U& b) const { a = static_cast<U>(a*b); } };
+      template<class F> static inli void Zip(T* w, const T* a, const T* b, size_t n, F f, false_type) {
+        for (size_t i = 0; i < n; i++) {
+          T x = a[i];
+          f(x, b[i]);
+          w[i] = x;
+        }
+      }
+      template<class F> static inli void Zip(T* w, const T* a, const T* b, size_t n, F f, true_type) { // w = f(a, b), element by element
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V x, y;
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+          Load(x, a+i);
+          Load(y, b+i);
+          f(x, y);
+          Store(w+i, x);
+        }
+        Zip(w+i, a+i, b+i, n-i, f, false_type());
+      }
+      static inli void Add(T* w, const T* a, const T* b, size_t n) { Zip(w, a, b, n, add(), vectors()); }
+      static inli void Sub(T* w, const T* a, const T* b, size_t n) { Zip(w, a, b, n, sub(), vectors()); }
+      static inli void Mul(T* w, const T* a, const T* b, size_t n) { Zip(w, a, b, n, mul(), vectors()); }
+      static inli void Clamp(T* w, size_t n, T lo, T hi) { Clamp(w, n, lo, hi, vectors()); }
+      static inli void Clamp(T* w, size_t n, T lo, T hi, false_type) {
+        for (size_t i = 0; i < n; i++) {
+          T x = w[i];
+          x = x < lo ? lo : x;
+          w[i] = x > hi ? hi : x;
+        }
+      }
+      static inli void Clamp(T* w, size_t n, T lo, T hi, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V vl, vh, x;
+        Splat(vl, lo);
+        Splat(vh, hi);
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+          Load(x, w+i);
+          Pick(x, vl, x < vl);
+          Pick(x, vh, x > vh);
+          Store(w+i, x);
+        }
+        Clamp(w+i, n-i, lo, hi, false_type());
+      }
+
+      static inli acc Sum(const T* p, size_t n) { return Pairwise(n, load1{p}); }
+      static inli acc SumKahan(const T* p, size_t n) { return SumKahan(p, n, vector_sums()); } // Compensated sum in every lane, and over the lanes
+      static inli acc SumKahan(const T* p, size_t n, integral_constant<int,2>) { return Sum(p, n); } // Exact anyway
+      template<class V> static inli void Kahan(V& s, V& c, const T* p) {
+        V y;
+        Load(y, p);
+        y -= c;
+        V t = s + y;
+        c = (t - s) - y;
+        s = t;
+      }
+      static inli acc SumKahan(const T* p, size_t n, integral_constant<int,1>) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V s0 = {}, s1 = {}, s2 = {}, s3 = {}, c0 = {}, c1 = {}, c2 = {}, c3 = {};
+        size_t i = 0;
+        for (; i + L <= n; i += L) {
+          Kahan(s0, c0, p+i);
+          Kahan(s1, c1, p+i+W);
+          Kahan(s2, c2, p+i+2*W);
+          Kahan(s3, c3, p+i+3*W);
+        }
+        acc s[L], c[L];
+        memcpy(s, &s0, sizeof(V));
+        memcpy(s+W, &s1, sizeof(V));
+        memcpy(s+2*W, &s2, sizeof(V));
+        memcpy(s+3*W, &s3, sizeof(V));
+        memcpy(c, &c0, sizeof(V));
+        memcpy(c+W, &c1, sizeof(V));
+        memcpy(c+2*W, &c2, sizeof(V));
+        memcpy(c+3*W, &c3, sizeof(V));
+        return KahanEnd(s, c, p, i, n);
+      }
+      static inli acc SumKahan(const T* p, size_t n, integral_constant<int,0>) {
+        acc s[L] = {}, c[L] = {};
+        size_t i = 0;
+        for (; i + L <= n; i += L) for (size_t j = 0; j < L; j++) {
+          acc y = static_cast<acc>(p[i+j]) - c[j];
+          acc t = s[j] + y;
+          c[j] = (t - s[j]) - y;
+          s[j] = t;
+        }
+        return KahanEnd(s, c, p, i, n);
+      }
+      static inli acc KahanEnd(acc* s, acc* c, const T* p, size_t i, size_t n) {
+        for (size_t j = 0; i + j < n; j++) {
+          acc y = static_cast<acc>(p[i+j]) - c[j];
+          acc t = s[j] + y;
+          c[j] = (t - s[j]) - y;
+          s[j] = t;
+        }
+        acc sum = 0, comp = 0;
+        for (size_t j = 0; j < L; j++) {
+          acc y = s[j] - (c[j] + comp);
+          acc t = sum + y;
+          comp = (t - sum) - y;
+          sum = t;
+        }
+        return sum;
+      }
+      static inli acc Dot(const T* a, const T* b, size_t n) { return Pairwise(n, load2{a, b}); }
+      static inli T Min(const T* p, size_t n) { return Min(p, n, vectors()); } // n > 0
+      static inli T Min(const T* p, size_t n, false_type) {
+        T m[L];
+        for (size_t j = 0; j < L; j++) m[j] = p[0];
+        size_t i = 0;
+        for (; i + L <= n; i += L) for (size_t j = 0; j < L; j++) m[j] = p[i+j] < m[j] ? p[i+j] : m[j];
+        return MinEnd(m, p, i, n);
+      }
+      static inli T Min(const T* p, size_t n, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V m0, x0, x1, x2, x3;
+        Splat(m0, p[0]);
+        V m1 = m0, m2 = m0, m3 = m0;
+        size_t i = 0;
+        for (; i + L <= n; i += L) {
+          Load(x0, p+i);
+          Load(x1, p+i+W);
+          Load(x2, p+i+2*W);
+          Load(x3, p+i+3*W);
+          Pick(m0, x0, x0 < m0);
+          Pick(m1, x1, x1 < m1);
+          Pick(m2, x2, x2 < m2);
+          Pick(m3, x3, x3 < m3);
+        }
+        T m[L];
+        memcpy(m, &m0, sizeof(V));
+        memcpy(m+W, &m1, sizeof(V));
+        memcpy(m+2*W, &m2, sizeof(V));
+        memcpy(m+3*W, &m3, sizeof(V));
+        return MinEnd(m, p, i, n);
+      }
+      static inli T MinEnd(T* m, const T* p, size_t i, size_t n) {
+        for (size_t j = 0; i + j < n; j++) m[j] = p[i+j] < m[j] ? p[i+j] : m[j];
+        for (size_t j = 1; j < L; j++) m[0] = m[j] < m[0] ? m[j] : m[0];
+        return m[0];
+      }
+      static inli T Max(const T* p, size_t n) { return Max(p, n, vectors()); } // n > 0
+      static inli T Max(const T* p, size_t n, false_type) {
+        T m[L];
+        for (size_t j = 0; j < L; j++) m[j] = p[0];
+        size_t i = 0;
+        for (; i + L <= n; i += L) for (size_t j = 0; j < L; j++) m[j] = p[i+j] > m[j] ? p[i+j] : m[j];
+        return MaxEnd(m, p, i, n);
+      }
+      static inli T Max(const T* p, size_t n, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        V m0, x0, x1, x2, x3;
+        Splat(m0, p[0]);
+        V m1 = m0, m2 = m0, m3 = m0;
+        size_t i = 0;
+        for (; i + L <= n; i += L) {
+          Load(x0, p+i);
+          Load(x1, p+i+W);
+          Load(x2, p+i+2*W);
+          Load(x3, p+i+3*W);
+          Pick(m0, x0, x0 > m0);
+          Pick(m1, x1, x1 > m1);
+          Pick(m2, x2, x2 > m2);
+          Pick(m3, x3, x3 > m3);
+        }
+        T m[L];
+        memcpy(m, &m0, sizeof(V));
+        memcpy(m+W, &m1, sizeof(V));
+        memcpy(m+2*W, &m2, sizeof(V));
+        memcpy(m+3*W, &m3, sizeof(V));
+        return MaxEnd(m, p, i, n);
+      }
+      static inli T MaxEnd(T* m, const T* p, size_t i, size_t n) {
+        for (size_t j = 0; i + j < n; j++) m[j] = p[i+j] > m[j] ? p[i+j] : m[j];
+        for (size_t j = 1; j < L; j++) m[0] = m[j] > m[0] ? m[j] : m[0];
+        return m[0];
+      }
+      static inli size_t Count(const T* p, size_t n, T x) {
+        size_t total = 0;
+        const size_t B = size_t(1) << 30; // Lane counters of 32 bits cannot overflow within a block
+        for (size_t from = 0; from < n; from += B) {
+          counter c[L] = {};
+          total += CountBlock(c, p + from, MZ_min(n - from, B), x, vectors());
+        }
+        return total;
+      }
+      static inli size_t CountBlock(counter* c, const T* q, size_t m, T x, false_type) {
+        size_t i = 0;
+        for (; i + L <= m; i += L) for (size_t j = 0; j < L; j++) c[j] += q[i+j] == x;
+        return CountEnd(c, q, i, m, x);
+      }
+      static inli size_t CountBlock(counter* c, const T* q, size_t m, T x, true_type) { // A comparison gives -1 in the lanes which are equal
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        typedef decltype(V() == V()) M;
+        V v, x0, x1, x2, x3;
+        Splat(v, x);
+        M c0 = {}, c1 = {}, c2 = {}, c3 = {};
+        size_t i = 0;
+        for (; i + L <= m; i += L) {
+          Load(x0, q+i);
+          Load(x1, q+i+W);
+          Load(x2, q+i+2*W);
+          Load(x3, q+i+3*W);
+          c0 -= x0 == v;
+          c1 -= x1 == v;
+          c2 -= x2 == v;
+          c3 -= x3 == v;
+        }
+        memcpy(c, &c0, sizeof(M));
+        memcpy(c+W, &c1, sizeof(M));
+        memcpy(c+2*W, &c2, sizeof(M));
+        memcpy(c+3*W, &c3, sizeof(M));
+        return CountEnd(c, q, i, m, x);
+      }
+      static inli size_t CountEnd(counter* c, const T* q, size_t i, size_t m, T x) {
+        for (size_t j = 0; i + j < m; j++) c[j] += q[i+j] == x;
+        size_t total = 0;
+        for (size_t j = 0; j < L; j++) total += c[j];
+        return total;
+      }
+      static inli size_t Find(const T* p, size_t n, T x) { // First index of x, or n. Blocks of 16*L elements are checked without branches, and only the one with x is searched
+        const size_t B = 16*L;
+        size_t i = 0;
+        for (; i + B <= n; i += B) if (Hit(p + i, x, vectors())) break;
+        for (; i < n; i++) if (p[i] == x) return i;
+        return n;
+      }
+      static inli bool Hit(const T* p, T x, false_type) { // Whether x is in the block
+        const size_t B = 16*L;
+        counter c[L] = {}, hit = 0;
+        for (size_t k = 0; k < B; k += L) for (size_t j = 0; j < L; j++) c[j] |= p[k+j] == x;
+        for (size_t j = 0; j < L; j++) hit |= c[j];
+        return hit != 0;
+      }
+      static inli bool Hit(const T* p, T x, true_type) {
+        typedef typename lot_simd_vec<T,Avector>::type V;
+        typedef decltype(V() == V()) M;
+        const size_t B = 16*L;
+        V v, x0, x1, x2, x3;
+        Splat(v, x);
+        M c0 = {}, c1 = {}, c2 = {}, c3 = {};
+        for (size_t k = 0; k < B; k += L) {
+          Load(x0, p+k);
+          Load(x1, p+k+W);
+          Load(x2, p+k+2*W);
+          Load(x3, p+k+3*W);
+          c0 |= x0 == v;
+          c1 |= x1 == v;
+          c2 |= x2 == v;
+          c3 |= x3 == v;
+        }
+        c0 |= c1 | c2 | c3;
+        counter c[W], hit = 0;
+        memcpy(c, &c0, sizeof(M));
+        for (size_t j = 0; j < W; j++) hit |= c[j];
+        return hit != 0;
+      }
+    };
+
+    // The entry points for one instruction set, with Avector bytes per vector register (0 for the fallback), and 4 registers per lane group
+#define MZ_SIMD_ENTRIES(name, target, Avector) \
+    struct name { \
+      template<class T> struct k: lot_simd_kernels<T, (Avector) ? 4*(Avector)/sizeof(T) : 4, Avector> {}; \
+      template<class T> static target void Fill(T* w, size_t n, T x) { k<T>::Fill(w, n, x); } \
+      template<class T> static target void Iota(T* w, size_t n, T start, T step) { k<T>::Iota(w, n, start, step); } \
+      template<class T> static target void Axpy(T* y, const T* x, size_t n, T a) { k<T>::Axpy(y, x, n, a); } \
+      template<class T> static target void Scale(T* w, size_t n, T a) { k<T>::Scale(w, n, a); } \
+      template<class T> static target void Add(T* w, const T* a, const T* b, size_t n) { k<T>::Add(w, a, b, n); } \
+      template<class T> static target void Sub(T* w, const T* a, const T* b, size_t n) { k<T>::Sub(w, a, b, n); } \
+      template<class T> static target void Mul(T* w, const T* a, const T* b, size_t n) { k<T>::Mul(w, a, b, n); } \
+      template<class T> static target void Clamp(T* w, size_t n, T lo, T hi) { k<T>::Clamp(w, n, lo, hi); } \
+      template<class T> static target typename lot_simd_acc<T>::type Sum(const T* p, size_t n) { return k<T>::Sum(p, n); } \
+      template<class T> static target typename lot_simd_acc<T>::type SumKahan(const T* p, size_t n) { return k<T>::SumKahan(p, n); } \
+      template<class T> static target typename lot_simd_acc<T>::type Dot(const T* a, const T* b, size_t n) { return k<T>::Dot(a, b, n); } \
+      template<class T> static target T Min(const T* p, size_t n) { return k<T>::Min(p, n); } \
+      template<class T> static target T Max(const T* p, size_t n) { return k<T>::Max(p, n); } \
+      template<class T> static target size_t Count(const T* p, size_t n, T x) { return k<T>::Count(p, n, x); } \
+      template<class T> static target size_t Find(const T* p, size_t n, T x) { return k<T>::Find(p, n, x); } \
+    };
+
+    MZ_SIMD_ENTRIES(lot_simd_scalar, , 0)
+  #if MZ_SIMD_X86
+    MZ_SIMD_ENTRIES(lot_simd_sse2, MZ_SIMD_SSE2, 16)
+    MZ_SIMD_ENTRIES(lot_simd_avx2, MZ_SIMD_AVX2, 32)
+    MZ_SIMD_ENTRIES(lot_simd_avx512, MZ_SIMD_AVX512, 64)
+  #else
+    typedef lot_simd_scalar lot_simd_sse2;
+    typedef lot_simd_scalar lot_simd_avx2;
+    typedef lot_simd_scalar lot_simd_avx512;
+  #endif
+#undef MZ_SIMD_ENTRIES
+
+#define MZ_SIMD_DISPATCH(op, ...) \
+    switch (Level()) { \
+      case avx512: return lot_simd_avx512::op(__VA_ARGS__); \
+      case avx2: return lot_simd_avx2::op(__VA_ARGS__); \
+      case ssse3: case sse2: return lot_simd_sse2::op(__VA_ARGS__); \
+      default: return lot_simd_scalar::op(__VA_ARGS__); \
+    }
+
+    struct lot_simd {
+      enum level { scalar, sse2, ssse3, avx2, avx512 }; // The kernels of ssse3 are those of sse2, the level is for the byte shuffles of lot_pack_delta
+      static const char* Name(level l) {
+        static const char* names[] = { "scalar","sse2","ssse3","avx2","avx512" };
+        return names[l];
+      }
+      static level Supported() { // The best instruction set of this CPU
+        static const level s = Detect();
+        return s;
+      }
+      static level Level() { return Current(); }
+      static void SetLevel(level l) { Current() = MZ_min(l, Supported()); } // For tests and benchmarks, not while kernels run on other threads
+
+      // Raw arrays
+      template<class T> static void Fill(T* w, size_t n, typename lot_simd_same<T>::type x) { MZ_SIMD_DISPATCH(Fill, w, n, x) }
+      template<class T> static void Iota(T* w, size_t n, typename lot_simd_same<T>::type start, typename lot_simd_same<T>::type step = 1) { MZ_SIMD_DISPATCH(Iota, w, n, start, step) } // w[i] = start+i*step
+      template<class T> static void Axpy(T* y, const T* x, size_t n, typename lot_simd_same<T>::type a) { MZ_SIMD_DISPATCH(Axpy, y, x, n, a) } // y += a*x
+      template<class T> static void Scale(T* w, size_t n, typename lot_simd_same<T>::type a) { MZ_SIMD_DISPATCH(Scale, w, n, a) }
+      template<class T> static void Add(T* w, const T* a, const T* b, size_t n) { MZ_SIMD_DISPATCH(Add, w, a, b, n) } // w may be a or b
+      template<class T> static void Sub(T* w, const T* a, const T* b, size_t n) { MZ_SIMD_DISPATCH(Sub, w, a, b, n) }
+      template<class T> static void Mul(T* w, const T* a, const T* b, size_t n) { MZ_SIMD_DISPATCH(Mul, w, a, b, n) }
+      template<class T> static void Clamp(T* w, size_t n, typename lot_simd_same<T>::type lo, typename lot_simd_same<T>::type hi) { MZ_SIMD_DISPATCH(Clamp, w, n, lo, hi) }
+      template<class T> static typename lot_simd_acc<T>::type Sum(const T* p, size_t n) { MZ_SIMD_DISPATCH(Sum, p, n) } // Pairwise, the error grows with log(n)
+      template<class T> static typename lot_simd_acc<T>::type SumKahan(const T* p, size_t n) { MZ_SIMD_DISPATCH(SumKahan, p, n) } // Compensated, slower but the error does not grow with n
+      template<class T> static typename lot_simd_acc<T>::type Dot(const T* a, const T* b, size_t n) { MZ_SIMD_DISPATCH(Dot, a, b, n) }
+      template<class T> static T Min(const T* p, size_t n) { MZ_SIMD_DISPATCH(Min, p, n) } // n must not be 0
+      template<class T> static T Max(const T* p, size_t n) { MZ_SIMD_DISPATCH(Max, p, n) }
+      template<class T> static size_t ArgMin(const T* p, size_t n) { return n ? Find(p, n, Min(p, n)) : 0; } // First index of the minimum
+      template<class T> static size_t ArgMax(const T* p, size_t n) { return n ? Find(p, n, Max(p, n)) : 0; }
+      template<class T> static size_t Count(const T* p, size_t n, typename lot_simd_same<T>::type x) { MZ_SIMD_DISPATCH(Count, p, n, x) }
+      template<class T> static size_t Find(const T* p, size_t n, typename lot_simd_same<T>::type x) { MZ_SIMD_DISPATCH(Find, p, n, x) } // First index of x, or n
+
+      // Lots
+      template<class L> static void Fill(L& l, typename L::lot_type x) { Fill(l.data(), l.size(), x); }
+      template<class L> static void Iota(L& l, typename L::lot_type start, typename L::lot_type step = 1) { Iota(l.data(), l.size(), start, step); }
+      template<class L> static void Axpy(L& y, typename L::lot_type a, L& x) { Axpy(y.data(), x.data(), Both(y, x), a); }
+      template<class L> static void Scale(L& l, typename L::lot_type a) { Scale(l.data(), l.size(), a); }
+      template<class L> static void Add(L& w, L& a, L& b) { w.resize(Both(a, b)); Add(w.data(), a.data(), b.data(), w.size()); } // w is resized, and may be a or b
+      template<class L> static void Sub(L& w, L& a, L& b) { w.resize(Both(a, b)); Sub(w.data(), a.data(), b.data(), w.size()); }
+      template<class L> static void Mul(L& w, L& a, L& b) { w.resize(Both(a, b)); Mul(w.data(), a.data(), b.data(), w.size()); }
+      template<class L> static void Clamp(L& l, typename L::lot_type lo, typename L::lot_type hi) { Clamp(l.data(), l.size(), lo, hi); }
+      template<class L> static typename lot_simd_acc<typename L::lot_type>::type Sum(L& l) { return Sum(l.data(), l.size()); }
+      template<class L> static typename lot_simd_acc<typename L::lot_type>::type SumKahan(L& l) { return SumKahan(l.data(), l.size()); }
+      template<class L> static typename lot_simd_acc<typename L::lot_type>::type Dot(L& a, L& b) { return Dot(a.data(), b.data(), Both(a, b)); }
+      template<class L> static typename L::lot_type Min(L& l) { return Min(l.data(), NotEmpty(l)); }
+      template<class L> static typename L::lot_type Max(L& l) { return Max(l.data(), NotEmpty(l)); }
+      template<class L> static size_t ArgMin(L& l) { return ArgMin(l.data(), l.size()); } // size() for an empty lot
+      template<class L> static size_t ArgMax(L& l) { return ArgMax(l.data(), l.size()); }
+      template<class L> static size_t Count(L& l, typename L::lot_type x) { return Count(l.data(), l.size(), x); }
+      template<class L> static size_t Find(L& l, typename L::lot_type x) { return Find(l.data(), l.size(), x); }
+    private:
+      static level Detect() {
+      #  if MZ_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return avx512;
+        if (__builtin_cpu_supports("avx2")) return avx2;
+        if (__builtin_cpu_supports("ssse3")) return ssse3;
+        if (__builtin_cpu_supports("sse2")) return sse2;
+      #  endif
+        return scalar;
+      }
+      static level& Current() {
+        static level l = Supported();
+        return l;
+      }
+      template<class L> static decltype(declval<L&>().size()) Both(const L& a, const L& b) { // Elements of two lots
+        if (L::lot_check && a.size() != b.size()) throw length_error("lot_simd: The lots differ in size!\n");
+        return MZ_min(a.size(), b.size());
+      }
+      template<class L> static size_t NotEmpty(const L& l) {
+        if (l.size() == 0) throw out_of_range("lot_simd: The lot is empty!\n");
+        return l.size();
+      }
+    };
+#undef MZ_SIMD_DISPATCH
+
+  }
+}
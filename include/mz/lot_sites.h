@@ -0,0 +1,158 @@
+#pragma once
+
+#include "lot_hooks.h"
+#include <mutex>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#if defined(__unix__) || defined(__APPLE__)
+#  include <dlfcn.h>
+#  define MZ_LOT_DLADDR 1
+#endif
+#if defined(__GNUC__)
+#  include <cxxabi.h>
+#  include <cstdlib>
+#endif
+// "lot_sites", hooks which attribute the growth of lots to the code which caused it: every reserve is counted for the innermost MZ_LOT_SITE scope of its thread, which names a source line, or otherwise for the return address of reserve. lot_site_profile sums up reserve calls, grows, allocated bytes (the new capacities) and moved bytes per site, and writes them as folded stacks (for flamegraph.pl) or as a legacy heap profile, which pprof reads together with the binary. The sites with the most growth are where a reserve would help. Return addresses are best effort: without MZ_LOT_SITE, a Grow that was not inlined (as without optimization) is reported as the site of all lots of its type.
+
+namespace std {
+  namespace mz {
+
+    struct lot_site {
+      const char* file;
+      int line;
+      const char* func;
+    };
+
+    class lot_site_scope { // Makes a site the current one of this thread, until the end of the scope
+    public:
+      explicit lot_site_scope(const lot_site* s):prev(Current()) { Current() = s; }
+      ~lot_site_scope() { Current() = prev; }
+      lot_site_scope(const lot_site_scope&) = delete;
+      lot_site_scope& operator=(const lot_site_scope&) = delete;
+      static const lot_site*& Current() { static thread_local const lot_site* s = nullptr; return s; }
+    private:
+      const lot_site* prev;
+    };
+
+#define MZ_LOT_SITE_CAT2(a,b) a##b
+#define MZ_LOT_SITE_CAT(a,b) MZ_LOT_SITE_CAT2(a,b)
+    // Attributes the growth of all lots up to the end of the enclosing scope to this line, for example "MZ_LOT_SITE; l.Add(x);"
+#define MZ_LOT_SITE static const std::mz::lot_site MZ_LOT_SITE_CAT(mz_lot_site_,__LINE__) = { __FILE__, __LINE__, __func__ }; std::mz::lot_site_scope MZ_LOT_SITE_CAT(mz_lot_site_scope_,__LINE__)(&MZ_LOT_SITE_CAT(mz_lot_site_,__LINE__))
+
+    class lot_site_profile {
+    public:
+      enum metric { allocated, copied, grown };
+      struct site_stats {
+        const lot_site* site; // nullptr if the site is only a return address
+        const void* caller; // The first return address of reserve seen for the site
+        unsigned long long reserves, grows, allocBytes, copiedBytes;
+        unsigned long long Get(metric m) const { return m == allocated ? allocBytes : m == copied ? copiedBytes : grows; }
+        string Name() const { // "func (file:line)", or the symbol of the return address
+          char buf[512];
+          if (site != nullptr) {
+            snprintf(buf, sizeof(buf), "%s (%s:%d)", site->func, site->file, site->line);
+            return buf;
+          }
+        #  ifdef MZ_LOT_DLADDR
+          Dl_info info;
+          if (dladdr(caller, &info) != 0 && info.dli_sname != nullptr) {
+            string name = info.dli_sname;
+          #  if defined(__GNUC__)
+            int status;
+            char* d = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            if (status == 0 && d != nullptr) name = d;
+            free(d);
+          #  endif
+            snprintf(buf, sizeof(buf), "+0x%llx", static_cast<unsigned long long>(reinterpret_cast<const char*>(caller) - reinterpret_cast<const char*>(info.dli_saddr)));
+            return name + buf;
+          }
+        #  endif
+          snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(reinterpret_cast<size_t>(caller)));
+          return buf;
+        }
+      };
+
+      static void Record(const lot_reserve_event& e) {
+        const lot_site* site = lot_site_scope::Current();
+        const void* key = site != nullptr ? static_cast<const void*>(site) : e.caller;
+        shard& s = Shards()[(reinterpret_cast<size_t>(key) >> 4) % shards];
+        lock_guard<mutex> lock(s.m);
+        auto it = s.sites.find(key);
+        if (it == s.sites.end()) it = s.sites.insert(make_pair(key, site_stats{ site, e.caller, 0, 0, 0, 0 })).first;
+        site_stats& st = it->second;
+        st.reserves++;
+        st.copiedBytes += e.copied;
+        if (e.newCap > e.oldCap) {
+          st.grows++;
+          st.allocBytes += e.newCap*e.elemSize;
+        }
+      }
+      static vector<site_stats> Sites(metric m = allocated) { // Sorted by m, the largest first
+        vector<site_stats> all;
+        for (unsigned k = 0; k < shards; k++) {
+          lock_guard<mutex> lock(Shards()[k].m);
+          for (auto& p: Shards()[k].sites) all.push_back(p.second);
+        }
+        sort(all.begin(), all.end(), [m](const site_stats& a,const site_stats& b) { return a.Get(m) > b.Get(m); });
+        return all;
+      }
+      static void Reset() {
+        for (unsigned k = 0; k < shards; k++) {
+          lock_guard<mutex> lock(Shards()[k].m);
+          Shards()[k].sites.clear();
+        }
+      }
+      static string Folded(metric m = allocated) { // One "lot;<site> <value>" line per site, for flamegraph.pl
+        string out;
+        for (const site_stats& s: Sites(m)) {
+          if (s.Get(m) == 0) continue;
+          string name = s.Name();
+          replace(name.begin(), name.end(), ';', ':');
+          out += "lot;" + name + " " + to_string(s.Get(m)) + "\n";
+        }
+        return out;
+      }
+      static string Pprof() { // Legacy heap profile of grows and allocated bytes per return address, read by "pprof -sample_index=alloc_space <binary> <file>"
+        vector<site_stats> all = Sites();
+        unsigned long long g = 0, b = 0;
+        for (const site_stats& s: all) { g += s.grows; b += s.allocBytes; }
+        char buf[256];
+        snprintf(buf, sizeof(buf), "heap profile: %llu: %llu [%llu: %llu] @ heapprofile\n", g, b, g, b);
+        string out = buf;
+        for (const site_stats& s: all) {
+          if (s.grows == 0) continue;
+          snprintf(buf, sizeof(buf), "%llu: %llu [%llu: %llu] @ 0x%llx\n", s.grows, s.allocBytes, s.grows, s.allocBytes, static_cast<unsigned long long>(reinterpret_cast<size_t>(s.caller)));
+          out += buf;
+        }
+        out += "\nMAPPED_LIBRARIES:\n";
+        if (FILE* f = fopen("/proc/self/maps", "r")) { // So that pprof can find the binaries of the addresses
+          size_t n;
+          while ((n = fread(buf, 1, sizeof(buf), f)) != 0) out.append(buf, n);
+          fclose(f);
+        }
+        return out;
+      }
+      static bool Dump(const char* path,const string& profile) { // For example Dump("lot.folded", lot_site_profile::Folded())
+        FILE* f = fopen(path, "w");
+        if (f == nullptr) return false;
+        bool ok = fwrite(profile.data(), 1, profile.size(), f) == profile.size();
+        return fclose(f) == 0 && ok;
+      }
+    private:
+      static const unsigned shards = 16;
+      struct shard {
+        mutex m;
+        unordered_map<const void*,site_stats> sites; // By site, or by return address
+      };
+      static shard* Shards() { static shard* s = new shard[shards]; return s; } // Never destroyed, so that static lots can still grow on exit
+    };
+
+    struct lot_sites: lot_nohooks {
+      void OnReserve(const lot_reserve_event& e) { lot_site_profile::Record(e); }
+    };
+
+  }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "lot_hooks.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdio>
+// "lot_stats", hooks which count what the growth of a lot costs: reserve calls, bytes moved to new memory, constructed and destructed elements, peak capacity, time spent in reserve and the slack (capacity - size). Every lot keeps its own counters (see gHooks), and adds them to the global ones (lot_stats::Global), which also collect the latencies of growth in a histogram, and can be written as JSON. The global counters are relaxed atomics, so every change of a size costs one atomic addition; without the hooks, nothing is counted at all.
+
+namespace std {
+  namespace mz {
+
+    // Histogram with 16 buckets per power of two, like HdrHistogram with 1 significant digit: a recorded value is known within 6.25%, over the whole range of 64 bit values. Recording is one relaxed atomic increment, so it can be shared by all threads
+    class lot_histogram {
+    public:
+      static const unsigned buckets = 61*16;
+      static unsigned Bucket(unsigned long long x) {
+        if (x < 16) return static_cast<unsigned>(x);
+        unsigned e = 63;
+        while (!(x >> e)) e--;
+        return (e - 3)*16 + static_cast<unsigned>((x >> (e - 4)) & 15);
+      }
+      static unsigned long long Lowest(unsigned b) { // Smallest value of bucket b
+        if (b < 16) return b;
+        return (16ull + b % 16) << (b/16 - 1);
+      }
+      static unsigned long long Highest(unsigned b) { return b + 1 < buckets ? Lowest(b + 1) - 1 : ~0ull; }
+
+      lot_histogram() { Reset(); }
+      void Record(unsigned long long x) {
+        counts[Bucket(x)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(x, memory_order_relaxed);
+        unsigned long long m = highest.load(memory_order_relaxed);
+        while (x > m && !highest.compare_exchange_weak(m, x, memory_order_relaxed)) {}
+      }
+      void Reset() {
+        for (auto& c: counts) c.store(0, memory_order_relaxed);
+        total.store(0, memory_order_relaxed);
+        sum.store(0, memory_order_relaxed);
+        highest.store(0, memory_order_relaxed);
+      }
+      unsigned long long Count() const { return total.load(memory_order_relaxed); }
+      unsigned long long Max() const { return highest.load(memory_order_relaxed); }
+      double Mean() const { return Count() ? static_cast<double>(sum.load(memory_order_relaxed))/static_cast<double>(Count()) : 0; }
+      unsigned long long Percentile(double q) const { // Highest value of the bucket which holds the q-quantile (0..1), at most Max
+        unsigned long long n = Count(), seen = 0, want = static_cast<unsigned long long>(q*static_cast<double>(n) + 0.5);
+        if (n == 0) return 0;
+        if (want == 0) want = 1;
+        for (unsigned b = 0; b < buckets; b++) {
+          seen += counts[b].load(memory_order_relaxed);
+          if (seen >= want) return min(Highest(b), Max());
+        }
+        return Max();
+      }
+      unsigned long long CountOf(unsigned b) const { return counts[b].load(memory_order_relaxed); }
+      void Json(string& out) const { // {"count":..,"mean":..,"p50":..,..,"max":..,"buckets":[[lowest,count],..]} with the non-empty buckets
+        char buf[256];
+        snprintf(buf, sizeof(buf), "{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"buckets\":[", Count(), Mean(), Percentile(0.5), Percentile(0.9), Percentile(0.99), Percentile(0.999), Max());
+        out += buf;
+        bool first = true;
+        for (unsigned b = 0; b < buckets; b++) {
+          unsigned long long c = CountOf(b);
+          if (c == 0) continue;
+          snprintf(buf, sizeof(buf), "%s[%llu,%llu]", first ? "" : ",", Lowest(b), c);
+          out += buf;
+          first = false;
+        }
+        out += "]}";
+      }
+    private:
+      atomic<unsigned long long> counts[buckets], total, sum, highest;
+    };
+
+    struct lot_stats_global { // Sums over all lots with lot_stats hooks
+      atomic<unsigned long long> reserves, grows, copiedBytes, constructed, destructed, growNs;
+      atomic<long long> capacityBytes, usedBytes, peakCapacityBytes; // Of the living lots
+      lot_histogram growLatency; // Nanoseconds of every reserve which increased a capacity
+
+      lot_stats_global() {
+        capacityBytes.store(0, memory_order_relaxed);
+        usedBytes.store(0, memory_order_relaxed);
+        Reset();
+      }
+      void Reset() { // The living lots stay counted in capacityBytes and usedBytes
+        for (auto* a: { &reserves, &grows, &copiedBytes, &constructed, &destructed, &growNs }) a->store(0, memory_order_relaxed);
+        peakCapacityBytes.store(capacityBytes.load(memory_order_relaxed), memory_order_relaxed);
+        growLatency.Reset();
+      }
+      void Size(long long dcap, long long dused) {
+        usedBytes.fetch_add(dused, memory_order_relaxed);
+        if (dcap == 0) return;
+        long long c = capacityBytes.fetch_add(dcap, memory_order_relaxed) + dcap, p = peakCapacityBytes.load(memory_order_relaxed);
+        while (c > p && !peakCapacityBytes.compare_exchange_weak(p, c, memory_order_relaxed)) {}
+      }
+      string Json() const {
+        char buf[512];
+        long long cb = capacityBytes.load(memory_order_relaxed), ub = usedBytes.load(memory_order_relaxed);
+        snprintf(buf, sizeof(buf), "{\"reserves\":%llu,\"grows\":%llu,\"copiedBytes\":%llu,\"constructed\":%llu,\"destructed\":%llu,\"growNs\":%llu,\"capacityBytes\":%lld,\"usedBytes\":%lld,\"slackBytes\":%lld,\"peakCapacityBytes\":%lld,\"growLatencyNs\":",
+          reserves.load(memory_order_relaxed), grows.load(memory_order_relaxed), copiedBytes.load(memory_order_relaxed), constructed.load(memory_order_relaxed), destructed.load(memory_order_relaxed), growNs.load(memory_order_relaxed), cb, ub, cb - ub, peakCapacityBytes.load(memory_order_relaxed));
+        string out = buf;
+        growLatency.Json(out);
+        out += "}";
+        return out;
+      }
+      bool Dump(const char* path) const { // Writes Json to a file
+        FILE* f = fopen(path, "w");
+        if (f == nullptr) return false;
+        string j = Json();
+        bool ok = fwrite(j.data(), 1, j.size(), f) == j.size();
+        return fclose(f) == 0 && ok;
+      }
+    };
+
+    struct lot_stats: lot_nohooks {
+      unsigned long long reserves = 0, grows = 0, copiedBytes = 0, constructed = 0, destructed = 0, growNs = 0; // Of this lot
+      size_t lastN = 0, lastCap = 0, peakCap = 0; // In elements
+
+      static const bool timed = true;
+      static unsigned long long Now() { return static_cast<unsigned long long>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()); }
+      static lot_stats_global& Global() { static lot_stats_global* g = new lot_stats_global(); return *g; } // Never destroyed, so that static lots can still use it on exit
+
+      void OnReserve(const lot_reserve_event& e) {
+        lot_stats_global& g = Global();
+        bool grow = e.newCap > e.oldCap;
+        reserves++;
+        grows += grow;
+        copiedBytes += e.copied;
+        constructed += e.constructed;
+        destructed += e.destructed;
+        peakCap = max(peakCap, e.newCap);
+        g.reserves.fetch_add(1, memory_order_relaxed);
+        g.copiedBytes.fetch_add(e.copied, memory_order_relaxed);
+        g.constructed.fetch_add(e.constructed, memory_order_relaxed);
+        g.destructed.fetch_add(e.destructed, memory_order_relaxed);
+        if (grow) {
+          growNs += e.ns;
+          g.grows.fetch_add(1, memory_order_relaxed);
+          g.growNs.fetch_add(e.ns, memory_order_relaxed);
+          g.growLatency.Record(e.ns);
+        }
+      }
+      void OnSize(size_t N, size_t cap, size_t elemSize, const char* (*)()) {
+        if (N == lastN && cap == lastCap) return;
+        Global().Size((static_cast<long long>(cap) - static_cast<long long>(lastCap))*static_cast<long long>(elemSize), (static_cast<long long>(N) - static_cast<long long>(lastN))*static_cast<long long>(elemSize));
+        lastN = N;
+        lastCap = cap;
+      }
+      size_t Slack() const { return lastCap - lastN; }
+      string Json() const {
+        char buf[384];
+        snprintf(buf, sizeof(buf), "{\"reserves\":%llu,\"grows\":%llu,\"copiedBytes\":%llu,\"constructed\":%llu,\"destructed\":%llu,\"growNs\":%llu,\"size\":%zu,\"capacity\":%zu,\"peakCapacity\":%zu,\"slack\":%zu}", reserves, grows, copiedBytes, constructed, destructed, growNs, lastN, lastCap, peakCap, Slack());
+        return buf;
+      }
+    };
+
+  }
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "lot_hooks.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdio>
+#if defined(__linux__)
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#  include <unistd.h>
+#endif
+// "lot_trace", hooks which record the begin and end of every reserve, Free, lots::DevReserve, DevFromHost and HostFromDev, with the element type, the bytes and the thread, as a timeline in Chrome trace JSON (for chrome://tracing or ui.perfetto.dev). Every thread writes into its own ring of the last MZ_LOT_TRACE_EVENTS events, without locks or atomic read-modify-writes (the ring of a thread which ended goes to the next new thread), and lot_trace_log::Flush collects the rings of all threads while they keep recording; events which were overwritten before a flush are counted as lost. Timestamps are microseconds of steady_clock (CLOCK_MONOTONIC on Linux, like the clocks of Perfetto and Chrome), and pid and tid are those of the system, so that the events line up with the spans of other tracers in the same process.
+
+namespace std {
+  namespace mz {
+
+#ifndef MZ_LOT_TRACE_EVENTS
+#  define MZ_LOT_TRACE_EVENTS 16384 // Events kept per thread, a power of two. Every thread which records has a ring of this many 32 byte slots (512 KiB), which threads started later reuse when it ended
+#endif
+
+    class lot_trace_log {
+    public:
+      static const size_t events = MZ_LOT_TRACE_EVENTS;
+      static_assert((events & (events - 1)) == 0, "MZ_LOT_TRACE_EVENTS has to be a power of two");
+
+      static unsigned long long Now() { return static_cast<unsigned long long>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()); }
+      static void Record(lot_op op,bool begin,const char* (*type)(),size_t bytes) {
+        ring& r = Ring();
+        unsigned long long h = r.head.load(memory_order_relaxed);
+        slot& s = r.slots[h & (events - 1)];
+        atomic_thread_fence(memory_order_release); // A flush which sees any of the new slot, also sees that the old one is gone
+        s.ns.store(Now(), memory_order_relaxed);
+        s.bytes.store(bytes, memory_order_relaxed);
+        s.type.store(type, memory_order_relaxed);
+        s.what.store(static_cast<unsigned>(op)*2 + begin, memory_order_relaxed);
+        r.head.store(h + 1, memory_order_release);
+      }
+      static size_t Flush(string& out) { // Appends the events since the last flush as comma separated trace events, returns their number
+        registry& g = Registry();
+        lock_guard<mutex> lock(g.m);
+        size_t n = g.ended;
+        out += g.pending;
+        g.pending.clear();
+        g.ended = 0;
+        for (ring* r: g.rings) Flush(g, *r, out, n);
+        return n;
+      }
+      static string Json() { // {"traceEvents":[...]} with the events since the last flush
+        string out = "{\"traceEvents\":[\n";
+        Flush(out);
+        out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+        return out;
+      }
+      static bool Dump(const char* path) { // Writes Json to a file
+        FILE* f = fopen(path, "w");
+        if (f == nullptr) return false;
+        string j = Json();
+        bool ok = fwrite(j.data(), 1, j.size(), f) == j.size();
+        return fclose(f) == 0 && ok;
+      }
+      static void Clear() { // Drops the events since the last flush
+        string ignored;
+        Flush(ignored);
+      }
+      static unsigned long long Lost() { // Events which were overwritten before a flush
+        registry& g = Registry();
+        lock_guard<mutex> lock(g.m);
+        return g.lost;
+      }
+      static size_t Rings() { // Rings of events allocated so far, at most one per thread which records at the same time
+        registry& g = Registry();
+        lock_guard<mutex> lock(g.m);
+        return g.rings.size();
+      }
+    private:
+      struct slot {
+        atomic<unsigned long long> ns;
+        atomic<size_t> bytes;
+        atomic<const char* (*)()> type;
+        atomic<unsigned> what; // 2*op + begin
+      };
+      struct event {
+        unsigned long long ns;
+        size_t bytes;
+        const char* (*type)();
+        unsigned what;
+      };
+      struct ring { // Written only by its thread, read by flushes
+        slot slots[events];
+        atomic<unsigned long long> head;
+        unsigned long long tail; // First event which was not flushed, under the mutex of the registry
+        unsigned long long tid;
+      };
+      struct registry {
+        mutex m;
+        vector<ring*> rings; // Of all threads which ever recorded, kept to the end of the process
+        vector<ring*> unused; // Rings of threads which ended, for new threads
+        string pending; // Events of threads which ended, for the next flush
+        size_t ended = 0; // Their number
+        unsigned long long lost = 0;
+      };
+      struct owner { ~owner() { Release(); } }; // Gives the ring of a thread back when it ends
+      static void Flush(registry& g,ring& r,string& out,size_t& n) { // Under the mutex of g
+        vector<event> copy;
+        unsigned long long h = r.head.load(memory_order_acquire), from = r.tail;
+        if (h - from > events) from = h - events;
+        for (unsigned long long i = from; i < h; i++) {
+          const slot& s = r.slots[i & (events - 1)];
+          copy.push_back(event{ s.ns.load(memory_order_relaxed), s.bytes.load(memory_order_relaxed), s.type.load(memory_order_relaxed), s.what.load(memory_order_relaxed) });
+        }
+        atomic_thread_fence(memory_order_acquire);
+        unsigned long long h2 = r.head.load(memory_order_relaxed), valid = h2 >= events ? h2 - events + 1 : 0; // The thread may be overwriting the slot of event h2 - events
+        valid = max(valid, from);
+        g.lost += valid - r.tail;
+        r.tail = h;
+        for (unsigned long long i = valid; i < h; i++) {
+          if (n++) out += ",\n";
+          Append(out, copy[static_cast<size_t>(i - from)], r.tid);
+        }
+      }
+      static registry& Registry() { static registry* g = new registry(); return *g; } // Never destroyed, so that static lots can still record on exit
+      static ring*& Current() { static thread_local ring* r = nullptr; return r; }
+      static ring& Ring() {
+        ring*& r = Current();
+        if (r == nullptr) {
+          unsigned long long tid = ThreadId();
+          registry& g = Registry();
+          {
+            lock_guard<mutex> lock(g.m);
+            if (!g.unused.empty()) {
+              r = g.unused.back();
+              g.unused.pop_back();
+              r->tid = tid; // Flushed when it was given back, so no event has the old tid
+            }
+          }
+          if (r == nullptr) {
+            ring* n = new ring();
+            n->head.store(0, memory_order_relaxed);
+            n->tail = 0;
+            n->tid = tid;
+            lock_guard<mutex> lock(g.m);
+            g.rings.push_back(n);
+            r = n;
+          }
+          static thread_local owner o; // Once per thread, a ring taken while the thread ends (by static lots) stays with it
+          static_cast<void>(o);
+        }
+        return *r;
+      }
+      static void Release() { // Moves the events of the ending thread to pending, so that its ring can be reused
+        ring*& r = Current();
+        if (r == nullptr) return;
+        registry& g = Registry();
+        lock_guard<mutex> lock(g.m);
+        Flush(g, *r, g.pending, g.ended);
+        g.unused.push_back(r);
+        r = nullptr;
+      }
+      static unsigned long long ThreadId() {
+      #  if defined(__linux__)
+        return static_cast<unsigned long long>(syscall(SYS_gettid));
+      #  else
+        static atomic<unsigned long long> next(1);
+        return next.fetch_add(1, memory_order_relaxed);
+      #  endif
+      }
+      static long long ProcessId() {
+      #  if defined(__unix__) || defined(__APPLE__)
+        return static_cast<long long>(getpid());
+      #  else
+        return 1;
+      #  endif
+      }
+      static void Append(string& out,const event& e,unsigned long long tid) {
+        char buf[256];
+        bool begin = e.what & 1;
+        snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"cat\":\"lot\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%lld,\"tid\":%llu,\"args\":{", lot_op_name(static_cast<lot_op>(e.what/2)), begin ? 'B' : 'E', e.ns/1000, e.ns%1000, ProcessId(), tid);
+        out += buf;
+        if (begin) {
+          out += "\"type\":\"";
+          for (const char* t = e.type ? e.type() : "?"; *t; t++) {
+            if (*t == '"' || *t == '\\') out += '\\';
+            out += *t;
+          }
+          out += "\"}}";
+        }
+        else {
+          snprintf(buf, sizeof(buf), "\"bytes\":%zu}}", e.bytes);
+          out += buf;
+        }
+      }
+    };
+
+    struct lot_trace: lot_nohooks {
+      void OnBegin(lot_op op,const char* (*type)()) { lot_trace_log::Record(op, true, type, 0); }
+      void OnEnd(lot_op op,size_t bytes) { lot_trace_log::Record(op, false, nullptr, bytes); }
+    };
+
+  }
+}
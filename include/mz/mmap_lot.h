@@ -0,0 +1,251 @@
+#pragma once
+
+#include "lot.h"
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// "mmap_lot", a lot whose memory is a shared mapping of a file, for trivially copyable types. The file starts with a 64 byte header (element size, count and a hash of the type), followed by the elements, so opening a file is one mmap, and reading it costs nothing but the page faults of what is actually used (lot_map::populate prefaults everything, lot_map::willneed starts asynchronous readahead). Growth extends the file with ftruncate and remaps it (mremap on Linux). Sync writes it back with msync, Close also trims the file to the used size. Files are only portable between builds with the same type layout and byte order, see lot_type_hash. Lots opened with lot_map::readonly only hand out const elements, the non-const accessors throw logic_error, because the pages cannot be written. POSIX only.
+
+namespace std {
+  namespace mz {
+
+    // Stored in the header, and checked when a file is opened. Hashes lot_type_name (without RTTI) and the size of the type, which is stable between builds of the same compiler. Specialize it for types which are shared between compilers
+    template<class Tv> struct lot_type_hash {
+      static ui64 value() {
+        ui64 h = 14695981039346656037ull; // FNV-1a
+        for (const char* c = lot_type_name<Tv>(); *c; c++) h = (h ^ static_cast<unsigned char>(*c))*1099511628211ull;
+        return (h ^ sizeof(Tv))*1099511628211ull;
+      }
+    };
+
+    struct lot_map {
+      enum flags: unsigned {
+        readwrite = 0, // Opens the file, or creates it if it does not exist
+        create = 1, // Starts with an empty file, even if it exists
+        readonly = 2,
+        populate = 4, // Prefaults the whole mapping on open (MAP_POPULATE)
+        willneed = 8, // Asks the kernel to read the file ahead (madvise(MADV_WILLNEED)), without waiting for it
+        sequential = 16 // Aggressive readahead, and early release of pages behind (madvise(MADV_SEQUENTIAL))
+      };
+      struct header {
+        char magic[8];
+        ui64 version, elemSize, count, typeHash, reserved[3];
+      };
+      static_assert(sizeof(header)==64,"lot_map: The header must have 64 bytes");
+      static const char* Magic() { return "mz::lot"; }
+    };
+
+    template <class Tv,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>> class mmap_lot {
+      static_assert(is_trivially_copyable<Tv>::value,"mmap_lot: Only trivially copyable types can be stored in files");
+      static_assert(alignof(Tv)<=sizeof(lot_map::header),"mmap_lot: The elements are only aligned to 64 bytes");
+    protected:
+      Tidx N,cap;
+      Tv* v;
+      lot_map::header* h; // Start of the mapping
+      size_t mapped; // Bytes
+      int fd;
+      bool writable;
+
+      static size_t Page() { static const size_t p = static_cast<size_t>(sysconf(_SC_PAGESIZE)); return p; }
+      static size_t Bytes(Tidx c) { return (sizeof(lot_map::header)+sizeof(Tv)*c+Page()-1)/Page()*Page(); }
+      static void Fail(const char* what) { throw system_error(errno, generic_category(), what); }
+      static void ReadOnly() { throw logic_error("mmap_lot: The file is not open for writing\n"); }
+      inli void Writable() const { if (!writable) ReadOnly(); } // Before handing out non-const elements
+      void OpenFail(const char* what) {
+        int e = errno;
+        Close();
+        throw system_error(e, generic_category(), what);
+      }
+      void Map(size_t bytes,unsigned flags) {
+        int f = MAP_SHARED;
+      #  ifdef MAP_POPULATE
+        if (flags & lot_map::populate) f |= MAP_POPULATE;
+      #  endif
+        void* p = mmap(nullptr,bytes,writable ? PROT_READ|PROT_WRITE : PROT_READ,f,fd,0);
+        if (p==MAP_FAILED) Fail("mmap_lot: mmap failed");
+        if (flags & lot_map::willneed) madvise(p,bytes,MADV_WILLNEED);
+        if (flags & lot_map::sequential) madvise(p,bytes,MADV_SEQUENTIAL);
+        Attach(p,bytes);
+      }
+      void Attach(void* p,size_t bytes) {
+        h = reinterpret_cast<lot_map::header*>(p);
+        v = reinterpret_cast<Tv*>(h+1);
+        mapped = bytes;
+        size_t c = (bytes-sizeof(lot_map::header))/sizeof(Tv);
+        cap = writable ? static_cast<Tidx>(MZ_min(c,static_cast<size_t>(numeric_limits<Tidx>::max()))) : N; // Read-only lots never write, because every Add has to grow
+      }
+      void Grow(Tidx nN) { reserve(MZ_max(nN,Tnextsize().nextsize(N))); }
+      template<typename U> inli void fill_up(const U& item) { v[N-1] = item; }
+      template<typename U,typename ...Args> inli void fill_up(const U& item,Args ...args) {
+        auto nn = sizeof...(Args)+1;
+        v[N-nn] = item;
+        fill_up(args...);
+      }
+    public:
+      typedef Tv lot_type;
+      static const bool lot_check = Acheck;
+      // Constructors etc...
+      inli mmap_lot():N(0),cap(0),v(nullptr),h(nullptr),mapped(0),fd(-1),writable(false) {}
+      mmap_lot(const char* path,unsigned flags = lot_map::readwrite):mmap_lot() { Open(path,flags); }
+      ~mmap_lot() { Close(); }
+      mmap_lot(const mmap_lot&) = delete;
+      mmap_lot& operator=(const mmap_lot&) = delete;
+      mmap_lot(mmap_lot&& l):mmap_lot() { swap(l); }
+      mmap_lot& operator=(mmap_lot&& l) { // The file of this lot is closed by l
+        swap(l);
+        return *this;
+      }
+
+      void Open(const char* path,unsigned flags = lot_map::readwrite) { // Maps the file, without reading any element
+        Close();
+        writable = !(flags & lot_map::readonly);
+        fd = ::open(path,writable ? O_RDWR|O_CREAT|((flags & lot_map::create) ? O_TRUNC : 0) : O_RDONLY,0644);
+        if (fd<0) Fail("mmap_lot: Cannot open the file");
+        struct stat st;
+        if (fstat(fd,&st)!=0) OpenFail("mmap_lot: fstat failed");
+        size_t bytes = static_cast<size_t>(st.st_size);
+        if (bytes==0 && writable) { // New file
+          bytes = Bytes(0);
+          if (ftruncate(fd,static_cast<off_t>(bytes))!=0) OpenFail("mmap_lot: ftruncate failed");
+          N = 0;
+          Map(bytes,flags);
+          memcpy(h->magic,lot_map::Magic(),8);
+          h->version = 1;
+          h->elemSize = sizeof(Tv);
+          h->count = 0;
+          h->typeHash = lot_type_hash<Tv>::value();
+          return;
+        }
+        lot_map::header hd;
+        if (bytes<sizeof(hd) || pread(fd,&hd,sizeof(hd),0)!=static_cast<ssize_t>(sizeof(hd)) || memcmp(hd.magic,lot_map::Magic(),8)!=0 || hd.version!=1) {
+          Close();
+          throw runtime_error("mmap_lot: Not a lot file\n");
+        }
+        if (hd.elemSize!=sizeof(Tv) || hd.typeHash!=lot_type_hash<Tv>::value()) {
+          Close();
+          throw runtime_error("mmap_lot: The file holds another element type\n");
+        }
+        if (hd.count>static_cast<ui64>(numeric_limits<Tidx>::max()) || sizeof(hd)+sizeof(Tv)*hd.count>bytes) {
+          Close();
+          throw length_error("mmap_lot: The file is truncated, or Tidx is too small\n");
+        }
+        N = static_cast<Tidx>(hd.count);
+        Map(bytes,flags);
+      }
+      void Sync(bool async = false) { // Writes the changes back to the file
+        if (h!=nullptr && writable && msync(h,mapped,async ? MS_ASYNC : MS_SYNC)!=0) Fail("mmap_lot: msync failed");
+      }
+      void Close() { // Unmaps the file, trims it to the used size, and leaves this lot empty. Without Sync before, the kernel writes the pages back whenever it wants
+        if (h!=nullptr) {
+          munmap(h,mapped);
+          if (writable && ftruncate(fd,static_cast<off_t>(sizeof(lot_map::header)+sizeof(Tv)*N))!=0) {} // The unused capacity is only lost space
+        }
+        if (fd>=0) ::close(fd);
+        N = cap = 0;
+        v = nullptr;
+        h = nullptr;
+        mapped = 0;
+        fd = -1;
+        writable = false;
+      }
+      inli bool IsOpen() const { return h!=nullptr; }
+      inli bool IsWritable() const { return writable; }
+
+      // Element access
+      inli Tv* data() { Writable(); return v; }
+      inli const Tv* data() const { return v; }
+      inli Tv& operator[] (Tidx i) {
+        Writable();
+        if (Acheck && i >= N) throw out_of_range("Lot access out of range!\n");
+        return v[i];
+      }
+      inli const Tv& operator[] (Tidx i) const {
+        if (Acheck && i >= N) throw out_of_range("Lot access out of range!\n");
+        return v[i];
+      }
+      inli Tv& front() { Writable(); return v[0]; }
+      inli const Tv& front() const { return v[0]; }
+      inli Tv& back() { Writable(); return v[N - 1]; }
+      inli const Tv& back() const { return v[N - 1]; }
+      inli Tv& at(Tidx i) {
+        Writable();
+        if (i >= N) throw out_of_range("Lot access out of range!\n"); else return v[i];
+      }
+      inli const Tv& at(Tidx i) const {
+        if (i >= N) throw out_of_range("Lot access out of range!\n"); else return v[i];
+      }
+      inli Tv& UncheckedAt(Tidx i) { Writable(); return v[i]; }
+      inli const Tv& UncheckedAt(Tidx i) const { return v[i]; }
+
+      // Iterators
+      inli Tv* begin() { Writable(); return v; }
+      inli Tv* end() { Writable(); return v + N; }
+      inli const Tv* begin() const { return v; }
+      inli const Tv* end() const { return v + N; }
+
+      // Capacity
+      inli Tidx size() const { return N; }
+      inli Tidx capacity() const { return cap; }
+      void reserve(Tidx ncap, bool allowshrink = false) { // Extends (or shrinks) the file, and remaps it, which may move the elements
+        Writable();
+        ncap = MZ_max(ncap, allowshrink ? N : cap);
+        size_t bytes = Bytes(ncap);
+        if (bytes==mapped) return;
+        if (bytes>mapped && ftruncate(fd,static_cast<off_t>(bytes))!=0) Fail("mmap_lot: ftruncate failed");
+      #  ifdef __linux__
+        void* p = mremap(h,mapped,bytes,MREMAP_MAYMOVE);
+        if (p==MAP_FAILED) Fail("mmap_lot: mremap failed");
+      #  else
+        munmap(h,mapped);
+        void* p = mmap(nullptr,bytes,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+        if (p==MAP_FAILED) { h = nullptr; Fail("mmap_lot: mmap failed"); }
+      #  endif
+        if (bytes<mapped && ftruncate(fd,static_cast<off_t>(bytes))!=0) {} // Only after the pages are gone, a failure only costs space
+        Attach(p,bytes);
+      }
+      void shrink_to_fit() { reserve(N, true); }
+
+      // Modifiers
+      inli void clear() { resize(0); }
+      inli void push_back(const Tv& arg) { Add(arg); }
+      inli void pop_back() { resize(N - 1); }
+      inli void resize(Tidx nN) {
+        if (nN > cap) Grow(nN);
+        N = nN;
+        if (writable) h->count = N; // Read-only lots can only shrink, without changing the file
+      }
+      void swap(mmap_lot& other) {
+        std::swap(N, other.N);
+        std::swap(cap, other.cap);
+        std::swap(v, other.v);
+        std::swap(h, other.h);
+        std::swap(mapped, other.mapped);
+        std::swap(fd, other.fd);
+        std::swap(writable, other.writable);
+      }
+
+      // More modifiers
+      void Add(const Tv* items,Tidx n) { // Bulk append, for example to save a lot
+        auto oldN = N;
+        resize(N + n);
+        lot_memcpy(static_cast<void*>(v + oldN), items, sizeof(Tv)*n);
+      }
+      inli void Add(const Tv& arg) {
+        resize(N + 1);
+        fill_up(arg);
+      }
+      Tv* AddEmpty() {
+        resize(N + 1);
+        return &v[N - 1];
+      }
+      template<typename ...Args> inli void Add(const Tv& arg,Args ...args) {
+        auto nn = static_cast<Tidx>(sizeof...(Args)+1);
+        resize(N + nn);
+        fill_up(arg, args...);
+      }
+    };
+
+  }
+}
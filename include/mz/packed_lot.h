@@ -0,0 +1,268 @@
+#pragma once
+
+#include "lot.h"
+#include "lot_simd.h"
+#if MZ_SIMD_X86
+#  include <tmmintrin.h>
+#  define MZ_SIMD_SSSE3 __attribute__((target("ssse3")))
+#endif
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+// "packed_lot", an append-only lot of ui32 values (like index arrays), compressed in blocks of 128 values. Tcodec decides the encoding: lot_pack_bits stores every block with the bit width of its largest value above the block minimum, in the 4 interleaved lanes of SIMD-BP128, so that decoding is vector shifts and masks, and a single value is one or two loads. lot_pack_delta stores the differences to the previous value in the byte-aligned format of StreamVByte (a 2 bit length per value, plus 1 to 4 data bytes), for sorted sequences with small gaps, and decodes 4 values per shuffle (SSSE3) and prefix sum. A header per block locates it, so operator[] only decodes within one block, but bulk Decode and ForEachBlock are much faster for scans. The last, incomplete block is kept uncompressed until it is full.
+
+namespace std {
+  namespace mz {
+
+    struct lot_pack_block { ui64 offset; ui32 base, aux; }; // Start of the block in the packed bytes, and what the codec needs to decode it
+
+    struct lot_pack_bits {
+      static const size_t maxBytes = 128*4;
+      static inli ui32 Mask(unsigned w) { return w >= 32 ? ~ui32(0) : (ui32(1) << w) - 1; }
+      static inli unsigned Width(ui32 x) { // Bits needed for x
+        if (x == 0) return 0;
+      #  if defined(__GNUC__)
+        return 32 - static_cast<unsigned>(__builtin_clz(x));
+      #  else
+        unsigned long r;
+        _BitScanReverse(&r, x);
+        return static_cast<unsigned>(r) + 1;
+      #  endif
+      }
+      static size_t Encode(const ui32* in, ui32, lot_pack_block& b, unsigned char* out) { // Value i goes to lane i%4, at bit (i/4)*w of the words of that lane
+        ui32 lo = in[0], hi = in[0];
+        for (unsigned i = 1; i < 128; i++) { lo = MZ_min(lo, in[i]); hi = MZ_max(hi, in[i]); }
+        unsigned w = Width(hi - lo);
+        b.base = lo;
+        b.aux = w;
+        ui32* words = reinterpret_cast<ui32*>(out);
+        memset(words, 0, 16*w);
+        for (unsigned i = 0; i < 128; i++) {
+          unsigned bit = (i >> 2)*w, s = bit & 31;
+          ui32 x = in[i] - lo, *q = words + (bit >> 5)*4 + (i & 3);
+          q[0] |= x << s;
+          if (s + w > 32) q[4] |= x >> (32 - s);
+        }
+        return 16*w;
+      }
+      static void DecodeScalar(const ui32* words, unsigned w, ui32 base, ui32* out) {
+        ui32 mask = Mask(w);
+        for (unsigned k = 0; k < 32; k++) {
+          unsigned bit = k*w, s = bit & 31;
+          const ui32* q = words + (bit >> 5)*4;
+          for (unsigned l = 0; l < 4; l++) {
+            ui32 x = q[l] >> s;
+            if (s + w > 32) x |= q[l+4] << (32 - s);
+            out[4*k+l] = base + (x & mask);
+          }
+        }
+      }
+    #  if MZ_SIMD_X86
+      static MZ_SIMD_SSE2 void DecodeSSE2(const ui32* words, unsigned w, ui32 base, ui32* out) { // The 4 lanes are one vector, shifted by the same count
+        __m128i vbase = _mm_set1_epi32(static_cast<int>(base)), vmask = _mm_set1_epi32(static_cast<int>(Mask(w)));
+        for (unsigned k = 0; k < 32; k++) {
+          unsigned bit = k*w, s = bit & 31;
+          const __m128i* q = reinterpret_cast<const __m128i*>(words + (bit >> 5)*4);
+          __m128i x = _mm_srl_epi32(_mm_loadu_si128(q), _mm_cvtsi32_si128(static_cast<int>(s)));
+          if (s + w > 32) x = _mm_or_si128(x, _mm_sll_epi32(_mm_loadu_si128(q + 1), _mm_cvtsi32_si128(static_cast<int>(32 - s))));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*k), _mm_add_epi32(vbase, _mm_and_si128(x, vmask)));
+        }
+      }
+    #  endif
+      static inli void Decode(const unsigned char* p, const lot_pack_block& b, ui32* out) {
+        if (b.aux == 0) {
+          for (unsigned i = 0; i < 128; i++) out[i] = b.base;
+          return;
+        }
+      #  if MZ_SIMD_X86
+        if (lot_simd::Level() >= lot_simd::sse2) return DecodeSSE2(reinterpret_cast<const ui32*>(p), b.aux, b.base, out);
+      #  endif
+        DecodeScalar(reinterpret_cast<const ui32*>(p), b.aux, b.base, out);
+      }
+      static inli ui32 Get(const unsigned char* p, const lot_pack_block& b, unsigned i) {
+        unsigned w = b.aux;
+        if (w == 0) return b.base;
+        unsigned bit = (i >> 2)*w, s = bit & 31;
+        const ui32* q = reinterpret_cast<const ui32*>(p) + (bit >> 5)*4 + (i & 3);
+        ui32 x = q[0] >> s;
+        if (s + w > 32) x |= q[4] << (32 - s);
+        return b.base + (x & Mask(w));
+      }
+    };
+
+    struct lot_pack_delta {
+      static const size_t maxBytes = 32 + 128*4; // Control bytes, and at most 4 data bytes per value
+      struct tables {
+        unsigned char shuffle[256][16], length[256]; // For every control byte: which data bytes go into the 4 values, and how many there are
+        tables() {
+          for (unsigned c = 0; c < 256; c++) {
+            unsigned o = 0;
+            for (unsigned j = 0; j < 4; j++) {
+              unsigned len = ((c >> (2*j)) & 3) + 1;
+              for (unsigned k = 0; k < 4; k++) shuffle[c][4*j+k] = static_cast<unsigned char>(k < len ? o + k : 0x80);
+              o += len;
+            }
+            length[c] = static_cast<unsigned char>(o);
+          }
+        }
+      };
+      static const tables& Tables() { static const tables t; return t; }
+      static size_t Encode(const ui32* in, ui32 prev, lot_pack_block& b, unsigned char* out) {
+        b.base = prev; // The value before the block
+        unsigned char* data = out + 32;
+        for (unsigned c = 0; c < 32; c++) {
+          unsigned ctrl = 0;
+          for (unsigned j = 0; j < 4; j++) {
+            ui32 d = in[4*c+j] - prev;
+            prev = in[4*c+j];
+            unsigned len = d < (1u << 8) ? 1 : d < (1u << 16) ? 2 : d < (1u << 24) ? 3 : 4;
+            for (unsigned k = 0; k < len; k++) *data++ = static_cast<unsigned char>(d >> (8*k));
+            ctrl |= (len - 1) << (2*j);
+          }
+          out[c] = static_cast<unsigned char>(ctrl);
+        }
+        b.aux = static_cast<ui32>(data - out);
+        return b.aux;
+      }
+      static void DecodeScalar(const unsigned char* p, ui32 prev, ui32* out, unsigned n) { // The first n values
+        const unsigned char* data = p + 32;
+        for (unsigned i = 0; i < n; i++) {
+          unsigned len = ((p[i >> 2] >> (2*(i & 3))) & 3) + 1;
+          ui32 d = 0;
+          for (unsigned k = 0; k < len; k++) d |= static_cast<ui32>(data[k]) << (8*k);
+          data += len;
+          out[i] = prev += d;
+        }
+      }
+    #  if MZ_SIMD_X86
+      static MZ_SIMD_SSSE3 void DecodeSSSE3(const unsigned char* p, ui32 prev, ui32* out) { // Reads up to 15 bytes beyond the block
+        const tables& t = Tables();
+        const unsigned char* data = p + 32;
+        __m128i carry = _mm_set1_epi32(static_cast<int>(prev));
+        for (unsigned c = 0; c < 32; c++) {
+          __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(t.shuffle[p[c]])));
+          data += t.length[p[c]];
+          d = _mm_add_epi32(d, _mm_slli_si128(d, 4)); // Prefix sum of the 4 differences
+          d = _mm_add_epi32(d, _mm_slli_si128(d, 8));
+          d = _mm_add_epi32(d, carry);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*c), d);
+          carry = _mm_shuffle_epi32(d, 0xFF);
+        }
+      }
+    #  endif
+      static inli void Decode(const unsigned char* p, const lot_pack_block& b, ui32* out) {
+      #  if MZ_SIMD_X86
+        if (lot_simd::Level() >= lot_simd::ssse3) return DecodeSSSE3(p, b.base, out);
+      #  endif
+        DecodeScalar(p, b.base, out, 128);
+      }
+      static inli ui32 Get(const unsigned char* p, const lot_pack_block& b, unsigned i) {
+        ui32 out[128];
+        DecodeScalar(p, b.base, out, i + 1);
+        return out[i];
+      }
+    };
+
+    template <class Tcodec = lot_pack_bits,bool Acheck = Acheck_def,class Tidx = ui32> class packed_lot {
+    public:
+      static const unsigned blockSize = 128;
+    protected:
+      static const size_t padding = 16; // Zero bytes behind the last block, for the overlapping loads of the decoders
+      lot<unsigned char,false,ui64> bytes; // All blocks, and the padding
+      lot<lot_pack_block,false,Tidx> blocks;
+      alignas(16) ui32 tail[blockSize]; // Values of the last block, before it is full
+      unsigned tailN;
+      ui32 last; // The last value of the last block, for the deltas
+
+      void Flush() { // Encodes the full tail
+        ui64 at = bytes.size() - padding;
+        bytes.resize(at + Tcodec::maxBytes + padding);
+        lot_pack_block b;
+        b.offset = at;
+        size_t n = Tcodec::Encode(tail, last, b, bytes.data() + at);
+        bytes.resize(at + n + padding);
+        memset(bytes.data() + at + n, 0, padding);
+        blocks.Add(b);
+        last = tail[blockSize - 1];
+        tailN = 0;
+      }
+      inli const unsigned char* BlockData(Tidx k) const { return const_cast<lot<unsigned char,false,ui64>&>(bytes).data() + blocks.UncheckedAt(k).offset; }
+    public:
+      typedef ui32 lot_type;
+      static const bool lot_check = Acheck;
+      // Constructors etc...
+      packed_lot():tailN(0),last(0) { bytes.resize(padding); memset(bytes.data(), 0, padding); }
+
+      // Element access
+      inli ui32 operator[] (Tidx i) const { // Decodes within the block of i, use Decode or ForEachBlock for scans
+        if (Acheck && i >= size()) throw out_of_range("Lot access out of range!\n");
+        Tidx k = i / blockSize;
+        if (k == blocks.size()) return tail[i % blockSize];
+        return Tcodec::Get(BlockData(k), blocks.UncheckedAt(k), i % blockSize);
+      }
+      inli ui32 back() const { return (*this)[size() - 1]; }
+      void Decode(Tidx from, Tidx n, ui32* out) const { // Values [from,from+n), whole blocks are decoded directly into out
+        if (Acheck && (from > size() || n > size() - from)) throw out_of_range("Lot access out of range!\n");
+        alignas(16) ui32 buf[blockSize];
+        while (n != 0) {
+          Tidx k = from / blockSize;
+          unsigned o = from % blockSize, m = static_cast<unsigned>(MZ_min(static_cast<Tidx>(blockSize - o), n));
+          if (k == blocks.size()) memcpy(out, tail + o, sizeof(ui32)*m);
+          else if (m == blockSize) Tcodec::Decode(BlockData(k), blocks.UncheckedAt(k), out);
+          else {
+            Tcodec::Decode(BlockData(k), blocks.UncheckedAt(k), buf);
+            memcpy(out, buf + o, sizeof(ui32)*m);
+          }
+          from = static_cast<Tidx>(from + m);
+          n = static_cast<Tidx>(n - m);
+          out += m;
+        }
+      }
+      template<class F> void ForEachBlock(F f) const { // Calls f(p,n,at) with the n decoded values of each block, which start at index at
+        alignas(16) ui32 buf[blockSize];
+        for (Tidx k = 0; k < blocks.size(); k++) {
+          Tcodec::Decode(BlockData(k), blocks.UncheckedAt(k), buf);
+          f(static_cast<const ui32*>(buf), static_cast<Tidx>(blockSize), static_cast<Tidx>(k*blockSize));
+        }
+        if (tailN != 0) f(static_cast<const ui32*>(tail), static_cast<Tidx>(tailN), static_cast<Tidx>(blocks.size()*blockSize));
+      }
+      template<class L> void ToLot(L& l) const { // Any lot of ui32
+        l.resize(size());
+        Decode(0, size(), l.data());
+      }
+
+      // Capacity
+      inli Tidx size() const { return static_cast<Tidx>(blocks.size()*blockSize + tailN); }
+      size_t MemoryBytes() const { return sizeof(*this) + bytes.capacity() + sizeof(lot_pack_block)*blocks.capacity(); } // Including the headers and the tail
+      void shrink_to_fit() {
+        bytes.shrink_to_fit();
+        blocks.shrink_to_fit();
+      }
+
+      // Modifiers, only appending
+      inli void clear() {
+        blocks.clear();
+        bytes.resize(padding);
+        tailN = 0;
+        last = 0;
+      }
+      inli void push_back(ui32 x) { Add(x); }
+      inli void Add(ui32 x) {
+        if (Acheck && size() == numeric_limits<Tidx>::max()) throw length_error("packed_lot: Tidx is too small for more elements\n");
+        tail[tailN++] = x;
+        if (tailN == blockSize) Flush();
+      }
+      void Add(const ui32* p, Tidx n) {
+        for (Tidx i = 0; i < n; i++) Add(p[i]);
+      }
+      template<class L> auto Add(L& l) -> typename enable_if<is_same<typename decay<decltype(*l.begin())>::type,ui32>::value>::type { // Any container of ui32 (lot, segmented_lot, vector, ...), not only contiguous ones
+        for (auto& x: l) Add(x);
+      }
+      void Free() {
+        clear();
+        shrink_to_fit();
+      }
+    };
+
+  }
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "lot.h"
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+// "segmented_lot", a lot whose memory consists of chunks that double in size (the first one holds 2^Abits elements), instead of one block. Growth only allocates the next chunk and never moves elements, so pointers and references to elements (like the one returned by AddEmpty) stay valid until their chunk is released by shrinking or Free. Element i is found with one bit scan, and iterators (or ForEachChunk) run over each chunk like over an array. Like lot, elements are constructed/destructed on memory reservation, one chunk at a time. Talloc and Tconstruct work as in lot.
+
+namespace std {
+  namespace mz {
+
+    template <class Tv,unsigned Abits = 4,bool Acheck = Acheck_def,class Tidx = ui32,class Talloc = lot_malloc,class Tconstruct = lot_construct_trivial> class segmented_lot: protected Talloc {
+      static_assert(Abits<sizeof(Tidx)*8,"segmented_lot: Abits must be smaller than the number of bits of Tidx");
+      static const unsigned maxChunks = sizeof(Tidx)*8-Abits; // So that the capacity always fits into Tidx
+    protected:
+      class segIt: public iterator<forward_iterator_tag,Tv> { // Iterator, which steps to the next chunk at the end of each chunk
+      public:
+        segIt(): l(nullptr),k(0),p(nullptr),e(nullptr) {}
+        segIt(const segmented_lot* sl,unsigned ck,Tv* cp): l(sl),k(ck),p(cp),e(cp ? sl->chunk[ck]+ChunkSize(ck) : nullptr) {}
+        inline Tv& operator*() const { return *p; }
+        inline Tv* operator->() const { return p; }
+        inline segIt& operator++() {
+          if (++p == e) {
+            if (++k < l->chunks) { p = l->chunk[k]; e = p+ChunkSize(k); }
+            else p = e = nullptr;
+          }
+          return *this;
+        }
+        inline segIt operator++(int) { segIt tmp(*this); ++*this; return tmp; }
+        inline bool operator==(const segIt& rhs) const { return p==rhs.p; }
+        inline bool operator!=(const segIt& rhs) const { return p!=rhs.p; }
+      private:
+        const segmented_lot* l;
+        unsigned k;
+        Tv *p,*e;
+      };
+
+      Tidx N,cap;
+      unsigned chunks; // Number of allocated chunks
+      Tv* chunk[maxChunks] = {};
+
+      static inli unsigned Log2(size_t x) {
+      #  if defined(__GNUC__)
+        return static_cast<unsigned>(sizeof(unsigned long long)*8-1)-static_cast<unsigned>(__builtin_clzll(x));
+      #  else
+        unsigned long r;
+        _BitScanReverse64(&r,x);
+        return static_cast<unsigned>(r);
+      #  endif
+      }
+      static inli size_t ChunkSize(unsigned k) { return size_t(1) << (Abits+k); }
+      static inli size_t ChunkStart(unsigned k) { return ChunkSize(k)-ChunkSize(0); } // Index of the first element of chunk k
+      inli Tv* Locate(Tidx i) const {
+        size_t j = static_cast<size_t>(i)+ChunkSize(0);
+        unsigned h = Log2(j);
+        return chunk[h-Abits]+(j-(size_t(1) << h));
+      }
+      void AddChunk() {
+        if (chunks == maxChunks) throw length_error("segmented_lot: Tidx is too small for more elements\n");
+        size_t n = ChunkSize(chunks);
+        Tv* w = reinterpret_cast<Tv*>(Tconstruct::zeroed ? this->AllocateZeroed(sizeof(Tv)*n,alignof(Tv)) : this->Allocate(sizeof(Tv)*n,alignof(Tv)));
+        if (w == nullptr) throw bad_alloc();
+        Tconstruct::Construct(w,Tidx(0),static_cast<Tidx>(n));
+        chunk[chunks++] = w;
+        cap = static_cast<Tidx>(ChunkStart(chunks));
+      }
+      void RemoveChunk() {
+        size_t n = ChunkSize(--chunks);
+        Tconstruct::Destruct(chunk[chunks],Tidx(0),static_cast<Tidx>(n));
+        this->Deallocate(chunk[chunks],sizeof(Tv)*n,alignof(Tv));
+        cap = static_cast<Tidx>(ChunkStart(chunks));
+      }
+      template<class U,class F> void Transfer(Tidx at,U* u,Tidx n,F f) { // Calls f(w,u,m) for the pieces of [at,at+n), split at the chunk boundaries
+        while (n != 0) {
+          size_t j = static_cast<size_t>(at)+ChunkSize(0);
+          unsigned h = Log2(j);
+          Tidx m = static_cast<Tidx>(MZ_min(static_cast<size_t>(n),(size_t(1) << (h+1))-j));
+          f(chunk[h-Abits]+(j-(size_t(1) << h)),u,m);
+          at = static_cast<Tidx>(at+m);
+          u += m;
+          n = static_cast<Tidx>(n-m);
+        }
+      }
+      inli void CopyFrom(const segmented_lot& l) {
+        resize(l.N);
+        l.ForEachChunk([this](const Tv* u,Tidx n,Tidx at) { Transfer(at,u,n,[](Tv* w,const Tv* p,Tidx m) { Tconstruct::Copy(w,p,m); }); });
+      }
+      template<typename U> inli void fill_up(const U& item) { *Locate(N-1) = item; }
+    #    ifndef useCUDA
+      template<typename U,typename ...Args> inli void fill_up(const U& item,Args ...args) {
+        auto nn = static_cast<Tidx>(sizeof...(Args)+1);
+        *Locate(N-nn) = item;
+        fill_up(args...);
+      }
+    #    endif
+    public:
+      typedef Tv lot_type;
+      typedef Talloc lot_alloc;
+      static const bool lot_check = Acheck;
+      // Constructors etc...
+      inli ~segmented_lot() { Free(); }
+      inli segmented_lot():N(0),cap(0),chunks(0) {}
+      inli explicit segmented_lot(const Talloc& a):Talloc(a),N(0),cap(0),chunks(0) {}
+      inli segmented_lot(Tidx startN,const Talloc& a = Talloc()):Talloc(a),N(0),cap(0),chunks(0) { resize(startN); }
+      inli segmented_lot(const segmented_lot& l):segmented_lot(l.gAlloc()) { CopyFrom(l); }
+      inli segmented_lot& operator=(const segmented_lot& l) { CopyFrom(l); return *this; }
+      inli segmented_lot(segmented_lot&& l):Talloc(std::move(l.gAlloc())),N(l.N),cap(l.cap),chunks(l.chunks) { // Takes the chunks along with the policy, like the move constructor of lot (swap would also swap the policies back)
+        for (unsigned k = 0; k < chunks; k++) {
+          chunk[k] = l.chunk[k];
+          l.chunk[k] = nullptr;
+        }
+        l.N = 0; l.cap = 0; l.chunks = 0;
+      }
+      inli segmented_lot& operator=(segmented_lot&& l) { // The chunks of this lot are released by l
+        swap(l);
+        l.clear();
+        return *this;
+      }
+      inli segmented_lot(initializer_list<Tv> l,const Talloc& a = Talloc()):Talloc(a),N(0),cap(0),chunks(0) {
+        reserve(static_cast<Tidx>(l.size()));
+        for (const Tv& x: l) Add(x);
+      }
+
+      inli Talloc& gAlloc() { return *this; }
+      inli const Talloc& gAlloc() const { return *this; }
+
+      // Element access
+      inli Tv& operator[] (Tidx i) const {
+        if (Acheck) {
+          if (i >= N) throw out_of_range("Lot access out of range!\n");
+          else return *Locate(i);
+        }
+        else return *Locate(i);
+      }
+      inli Tv& front() { return *chunk[0]; }
+      inli Tv& back() { return *Locate(N - 1); }
+      inli Tv& at(Tidx i) const {
+        if (i >= N) throw out_of_range("Lot access out of range!\n"); else return *Locate(i);
+      }
+      inli Tv& UncheckedAt(Tidx i) const { return *Locate(i); }
+      template<class F> void ForEachChunk(F f) const { // Calls f(p,n,at) for the used part of every chunk, with p pointing to n elements which start at index at
+        for (unsigned k = 0; k < chunks && ChunkStart(k) < N; k++)
+          f(chunk[k],static_cast<Tidx>(MZ_min(ChunkSize(k),N-ChunkStart(k))),static_cast<Tidx>(ChunkStart(k)));
+      }
+      inli unsigned ChunkCount() const { return chunks; }
+
+      // Iterators
+      inli segIt begin() const { return N ? segIt(this,0,chunk[0]) : end(); }
+      inli segIt end() const {
+        if (N == cap) return segIt();
+        size_t j = static_cast<size_t>(N)+ChunkSize(0);
+        unsigned h = Log2(j);
+        return segIt(this,h-Abits,chunk[h-Abits]+(j-(size_t(1) << h)));
+      }
+
+      // Capacity
+      inli Tidx size() const { return N; }
+      inli Tidx capacity() const { return cap; }
+      void reserve(Tidx ncap, bool allowshrink = false) { // Shrinking releases whole chunks only
+        while (cap < ncap) AddChunk();
+        if (allowshrink) while (chunks != 0 && ChunkStart(chunks-1) >= MZ_max(ncap,N)) RemoveChunk();
+      }
+      void shrink_to_fit() { reserve(N, true); }
+
+      // Modifiers
+      inli void clear() { N = 0; }
+      inli void push_back(const Tv& arg) { Add(arg); }
+      inli void pop_back() { resize(N - 1); }
+      inli void resize(Tidx nN) { if (nN > cap) reserve(nN); N = nN; }
+      void swap(segmented_lot& other) {
+        for (unsigned k = 0; k < MZ_max(chunks, other.chunks); k++) std::swap(chunk[k], other.chunk[k]);
+        std::swap(N, other.N);
+        std::swap(cap, other.cap);
+        std::swap(chunks, other.chunks);
+        std::swap(gAlloc(), other.gAlloc());
+      }
+
+      // More modifiers
+      void Take(segmented_lot& l) { // Appends the elements of l and leaves l empty, swapping the chunks if this lot is empty
+        if (&l == this) return;
+        if (N == 0) swap(l);
+        else {
+          auto oldN = N;
+          resize(N + l.N);
+          l.ForEachChunk([this,oldN](Tv* u,Tidx n,Tidx at) { Transfer(static_cast<Tidx>(oldN+at),u,n,[](Tv* w,Tv* p,Tidx m) { Tconstruct::Move(w,p,m); }); });
+        }
+        l.clear();
+      }
+      void Add(const segmented_lot& l) {
+        auto oldN = N, n = l.N; // l may be this lot
+        resize(N + n);
+        for (unsigned k = 0; k < l.chunks && ChunkStart(k) < n; k++)
+          Transfer(static_cast<Tidx>(oldN+ChunkStart(k)),static_cast<const Tv*>(l.chunk[k]),static_cast<Tidx>(MZ_min(ChunkSize(k),n-ChunkStart(k))),[](Tv* w,const Tv* p,Tidx m) { Tconstruct::Copy(w,p,m); });
+      }
+      inli void Add(const Tv& arg) {
+        resize(N + 1);
+        fill_up(arg);
+      }
+      Tv* AddEmpty() { // The pointer stays valid while the lot grows
+        resize(N + 1);
+        return Locate(N - 1);
+      }
+      template<typename ...Args> inli void Add(Args ...args) {
+        auto nn = static_cast<Tidx>(sizeof...(Args));
+        resize(N + nn);
+        fill_up(args...);
+      }
+      void Free() {
+        clear();
+        while (chunks != 0) RemoveChunk();
+      }
+    };
+
+  }
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "lot.h"
+// "small_lot", a lot which keeps up to Ainline elements inside the object itself, and only moves them to the heap when it grows beyond that. Like lot, elements are constructed/destructed on memory reservation: the Ainline inline elements are constructed together with the small_lot, and capacity() is never smaller than Ainline. Tnextsize, Talloc and Tconstruct work as in lot, Talloc is only used for the heap memory.
+
+namespace std {
+  namespace mz {
+
+    template <class Tv,size_t Ainline,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,class Tconstruct = lot_construct_trivial> class small_lot: protected Talloc {
+      static_assert(Ainline>0,"small_lot: Ainline must not be 0, use lot instead");
+    protected:
+      Tidx N,cap;
+      Tv* v; // Points either to buf, or to heap memory. Inline elements are only constructed while in use
+      alignas(Tv) unsigned char buf[sizeof(Tv)*Ainline];
+
+      inli Tv* Inline() { return reinterpret_cast<Tv*>(buf); }
+      void Grow(Tidx nN) { reserve(MZ_max(nN,Tnextsize().nextsize(N))); }
+      static void Relocate(Tv* w,Tv* u,Tidx n) { // Moves n constructed elements from u to uninitialized memory at w
+        if (lot_relocatable<Tv>::value) lot_memcpy(static_cast<void*>(w),u,sizeof(Tv)*n);
+        else for (Tidx i = 0; i < n; i++) {
+          new(&w[i]) Tv(std::move(u[i]));
+          u[i].~Tv();
+        }
+      }
+      void ResetInline() { // Only for heap memory which was already handed over to someone else
+        v = Inline();
+        cap = static_cast<Tidx>(Ainline);
+        if (Tconstruct::zeroed) memset(buf, 0, sizeof(buf));
+        Tconstruct::Construct(v, Tidx(0), cap);
+      }
+      void Release() { // Destructs everything, and leaves v without any constructed elements
+        Tconstruct::Destruct(v, Tidx(0), cap);
+        if (!IsInline()) this->Deallocate(v, sizeof(Tv)*cap, alignof(Tv));
+      }
+      inli void CopyFrom(const small_lot& l) {
+        resize(l.size());
+        Tconstruct::Copy(v, l.v, N);
+      }
+      template<typename U> inli void fill_up(const U& item) { v[N-1] = item; }
+    #    ifndef useCUDA
+      template<typename U,typename ...Args> inli void fill_up(const U& item,Args ...args) {
+        auto nn = sizeof...(Args)+1;
+        v[N-nn] = item;
+        fill_up(args...);
+      }
+    #    endif
+    public:
+      typedef Tv lot_type;
+      typedef Talloc lot_alloc;
+      static const size_t lot_inline = Ainline;
+      static const bool lot_check = Acheck;
+      // Constructors etc...
+      inli ~small_lot() { Release(); }
+      inli small_lot():N(0) { ResetInline(); }
+      inli explicit small_lot(const Talloc& a):Talloc(a),N(0) { ResetInline(); }
+      inli small_lot(Tidx startN,const Talloc& a = Talloc()):Talloc(a),N(0) { ResetInline(); resize(startN); }
+      inli small_lot(const small_lot& l):small_lot(l.gAlloc()) { CopyFrom(l); }
+      inli small_lot& operator=(const small_lot& l) { CopyFrom(l); return *this; }
+      small_lot(small_lot&& l):Talloc(l.gAlloc()),N(0) {
+        if (l.IsInline()) { // Inline elements have to be moved one by one
+          ResetInline();
+          for (Tidx i = 0; i < l.N; i++) v[i] = std::move(l.v[i]);
+        }
+        else { // Heap memory is simply taken over
+          v = l.v;
+          cap = l.cap;
+          l.ResetInline();
+        }
+        N = l.N;
+        l.N = 0;
+      }
+      small_lot& operator=(small_lot&& l) {
+        if (this == &l) return *this;
+        if (l.IsInline()) {
+          resize(l.N);
+          for (Tidx i = 0; i < l.N; i++) v[i] = std::move(l.v[i]);
+        }
+        else {
+          Release();
+          v = l.v;
+          cap = l.cap;
+          std::swap(gAlloc(),l.gAlloc()); // The memory belongs to the allocation policy
+          l.ResetInline();
+        }
+        N = l.N;
+        l.N = 0;
+        return *this;
+      }
+      inli small_lot(initializer_list<Tv> l,const Talloc& a = Talloc()):Talloc(a),N(0) {
+        ResetInline();
+        resize(static_cast<Tidx>(l.size()));
+        copy(l.begin(),l.end(),v);
+      }
+
+      inli Talloc& gAlloc() { return *this; }
+      inli const Talloc& gAlloc() const { return *this; }
+      inli bool IsInline() const { return v == reinterpret_cast<const Tv*>(buf); }
+
+      // Element access
+      inli Tv* data() { return v; }
+      inli Tv& operator[] (Tidx i) const {
+        if (Acheck) {
+          if (i >= N) throw out_of_range("Lot access out of range!\n");
+          else return v[i];
+        }
+        else return v[i];
+      }
+      inli Tv& front() { return v[0]; }
+      inli Tv& back() { return v[N - 1]; }
+      inli Tv& at(Tidx i) const {
+        if (i >= N) throw out_of_range("Lot access out of range!\n"); else return v[i];
+      }
+      inli Tv& UncheckedAt(Tidx i) const { return v[i]; }
+
+      // Iterators
+      inli Tv* begin() const { return v; }
+      inli Tv* end()   const { return v + N; }
+
+      // Capacity
+      inli Tidx size() const { return N; }
+      inli Tidx capacity() const { return cap; }
+      void reserve(Tidx ncap, bool allowshrink = false) {
+        ncap = MZ_max(MZ_max(ncap, allowshrink ? N : cap), static_cast<Tidx>(Ainline));
+        if (ncap == cap) return;
+        if (ncap < cap) Tconstruct::Destruct(v, ncap, cap);
+        Tidx kept = MZ_min(cap,ncap);
+        Tv* w;
+        if (ncap == static_cast<Tidx>(Ainline)) { // Shrinking back into the object
+          w = Inline();
+          Relocate(w, v, kept);
+          this->Deallocate(v, sizeof(Tv)*cap, alignof(Tv));
+        }
+        else {
+          if (!IsInline() && (lot_relocatable<Tv>::value || lot_inplace<Talloc>::value)) w = reinterpret_cast<Tv*>(Tconstruct::zeroed ? this->ReallocateZeroed(v, sizeof(Tv)*cap, sizeof(Tv)*ncap, alignof(Tv)) : this->Reallocate(v, sizeof(Tv)*cap, sizeof(Tv)*ncap, alignof(Tv)));
+          else w = reinterpret_cast<Tv*>(Tconstruct::zeroed ? this->AllocateZeroed(sizeof(Tv)*ncap, alignof(Tv)) : this->Allocate(sizeof(Tv)*ncap, alignof(Tv)));
+          if (w == nullptr) throw bad_alloc();
+          if (IsInline()) Relocate(w, v, kept);
+          else if (!lot_relocatable<Tv>::value && !lot_inplace<Talloc>::value) {
+            Relocate(w, v, kept);
+            this->Deallocate(v, sizeof(Tv)*cap, alignof(Tv));
+          }
+          ncap = static_cast<Tidx>(MZ_min(this->Usable(w, sizeof(Tv)*ncap, alignof(Tv))/sizeof(Tv), static_cast<size_t>(numeric_limits<Tidx>::max())));
+        }
+        if (kept < ncap) Tconstruct::Construct(w, kept, ncap);
+        cap = ncap;
+        v = w;
+      }
+      void shrink_to_fit() { reserve(N, true); }
+
+      // Modifiers
+      inli void clear() { N = 0; }
+      inli void push_back(const Tv& arg) { Add(arg); }
+      inli void pop_back() { resize(N - 1); }
+      inli void resize(Tidx nN) { if (nN > cap) Grow(nN); N = nN; }
+
+      // More modifiers
+      void Take(small_lot& l) { // Appends the elements of l and leaves l empty, taking over its heap memory if this small_lot is empty
+        if (&l == this) return;
+        if (N == 0 && !l.IsInline()) *this = std::move(l);
+        else {
+          auto oldN = N, n = l.N;
+          resize(N + n);
+          Tconstruct::Move(v + oldN, l.v, n);
+          l.clear();
+        }
+      }
+      void Add(const small_lot& l) {
+        auto oldN = N, n = l.N; // l may be this lot
+        resize(N + n);
+        Tconstruct::Copy(v + oldN, l.v, n);
+      }
+      inli void Add(const Tv& arg) {
+        resize(N + 1);
+        fill_up(arg);
+      }
+      Tv* AddEmpty() {
+        resize(N + 1);
+        return &v[N - 1];
+      }
+      template<typename ...Args> inli void Add(Args ...args) {
+        auto nn = static_cast<Tidx>(sizeof...(Args));
+        resize(N + nn);
+        fill_up(args...);
+      }
+      void Free() { // Returns to the inline memory
+        clear();
+        reserve(0, true);
+      }
+    };
+
+  }
+}
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "lot.h"
+#include <tuple>
+// "soa_lot", a lot of rows with the fields Ts..., stored as a structure of arrays: every field has its own contiguous column, so that loops which read only a few fields only load those. All columns share one size, capacity and growth policy, and they live in a single block (each column starts at an Aalign boundary, for vector loads), so growth is one allocation. data<K>() is column K, operator[] and the iterators return row proxies. Like lot, elements are constructed/destructed on memory reservation. soa_lot<Ts...> uses the defaults of lot, basic_soa_lot<tuple<Ts...>,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct> takes the same policies as lot.
+
+namespace std {
+  namespace mz {
+
+    template<size_t... K> struct soa_index {};
+    template<size_t N,size_t... K> struct soa_make_index: soa_make_index<N-1,N-1,K...> {};
+    template<size_t... K> struct soa_make_index<0,K...> { typedef soa_index<K...> type; };
+    template<size_t A,size_t... B> struct soa_max: integral_constant<size_t,A> {};
+    template<size_t A,size_t B,size_t... C> struct soa_max<A,B,C...>: soa_max<(A > B ? A : B),C...> {};
+
+    template <class Tcols,bool Acheck = Acheck_def,class Tidx = ui32,class Tnextsize = lot_nextsize<Tidx>,class Talloc = lot_malloc,size_t Aalign = 64,class Tconstruct = lot_construct_trivial> class basic_soa_lot;
+
+    template <class... Ts,bool Acheck,class Tidx,class Tnextsize,class Talloc,size_t Aalign,class Tconstruct> class basic_soa_lot<tuple<Ts...>,Acheck,Tidx,Tnextsize,Talloc,Aalign,Tconstruct>: protected Talloc {
+      static_assert(sizeof...(Ts)>0,"soa_lot: At least one column is needed");
+      static_assert((Aalign & (Aalign-1)) == 0,"soa_lot: Aalign must be a power of 2");
+      typedef typename soa_make_index<sizeof...(Ts)>::type columns;
+    public:
+      template<size_t K> using col_type = typename tuple_element<K,tuple<Ts...>>::type;
+      typedef tuple<Ts...> lot_type;
+      typedef Talloc lot_alloc;
+      static const size_t lot_align = Aalign;
+      static const bool lot_check = Acheck;
+
+      class row { // Proxy for the fields of row i. Assigning a row or a tuple copies the values
+      public:
+        row(const basic_soa_lot* sl,Tidx ri): l(sl),i(ri) {}
+        template<size_t K> inli col_type<K>& get() const { return std::get<K>(l->cols)[i]; }
+        inli Tidx index() const { return i; }
+        operator tuple<Ts...>() const { return Load(columns()); }
+        const row& operator=(const tuple<Ts...>& t) const { Store(columns(), t); return *this; }
+        const row& operator=(const row& r) const { Store(columns(), tuple<Ts...>(r)); return *this; }
+      private:
+        template<size_t... K> tuple<Ts...> Load(soa_index<K...>) const { return tuple<Ts...>(std::get<K>(l->cols)[i]...); }
+        template<size_t... K> void Store(soa_index<K...>,const tuple<Ts...>& t) const {
+          int d[] = { 0, (std::get<K>(l->cols)[i] = std::get<K>(t), 0)... };
+          (void)d;
+        }
+        const basic_soa_lot* l;
+        Tidx i;
+      };
+      class rowIt: public iterator<input_iterator_tag,row,ptrdiff_t,void,row> { // Iterator, with the arithmetic of a random access iterator, but a proxy as reference
+      public:
+        rowIt(): l(nullptr),i(0) {}
+        rowIt(const basic_soa_lot* sl,Tidx ri): l(sl),i(ri) {}
+        inline row operator*() const { return row(l,i); }
+        inline row operator[](ptrdiff_t d) const { return row(l,static_cast<Tidx>(i+d)); }
+        inline rowIt& operator++() { ++i; return *this; }
+        inline rowIt& operator--() { --i; return *this; }
+        inline rowIt operator++(int) { rowIt tmp(*this); ++i; return tmp; }
+        inline rowIt operator--(int) { rowIt tmp(*this); --i; return tmp; }
+        inline rowIt& operator+=(ptrdiff_t d) { i = static_cast<Tidx>(i+d); return *this; }
+        inline rowIt& operator-=(ptrdiff_t d) { i = static_cast<Tidx>(i-d); return *this; }
+        inline rowIt operator+(ptrdiff_t d) const { return rowIt(l,static_cast<Tidx>(i+d)); }
+        inline rowIt operator-(ptrdiff_t d) const { return rowIt(l,static_cast<Tidx>(i-d)); }
+        inline ptrdiff_t operator-(const rowIt& rhs) const { return static_cast<ptrdiff_t>(i)-static_cast<ptrdiff_t>(rhs.i); }
+        inline bool operator==(const rowIt& rhs) const { return i==rhs.i; }
+        inline bool operator!=(const rowIt& rhs) const { return i!=rhs.i; }
+        inline bool operator<(const rowIt& rhs) const { return i<rhs.i; }
+      private:
+        const basic_soa_lot* l;
+        Tidx i;
+      };
+
+    protected:
+      Tidx N,cap;
+      void* block; // All columns
+      tuple<Ts*...> cols;
+
+      static const size_t align = soa_max<Aalign,alignof(Ts)...>::value;
+      static size_t Round(size_t bytes) { return (bytes+align-1) & ~(align-1); }
+      static size_t Offset(size_t k,Tidx c) { // Of column k in a block for c rows
+        const size_t sizes[] = { sizeof(Ts)... };
+        size_t o = 0;
+        for (size_t j = 0; j < k; j++) o = Round(o+sizes[j]*c);
+        return o;
+      }
+      template<size_t... K> static tuple<Ts*...> Columns(soa_index<K...>,void* w,Tidx c) { return tuple<Ts*...>(reinterpret_cast<Ts*>(static_cast<char*>(w)+Offset(K,c))...); }
+      template<size_t K,class F,class... P> static void EachColumn(const F& f,P&... t) { f(std::get<K>(t)...); }
+      template<class F,size_t... K,class... P> static void Each(soa_index<K...>,const F& f,P&... t) { // Calls f with column K of every tuple t, for every K
+        int d[] = { 0, (EachColumn<K>(f,t...), 0)... };
+        (void)d;
+      }
+
+      struct relocate { // Moves n constructed elements to uninitialized memory
+        Tidx n;
+        template<class T> void operator()(T* w,T* u) const {
+          if (lot_relocatable<T>::value) lot_memcpy(static_cast<void*>(w),u,sizeof(T)*n);
+          else for (Tidx i = 0; i < n; i++) {
+            new(&w[i]) T(std::move(u[i]));
+            u[i].~T();
+          }
+        }
+      };
+      struct construct { Tidx from,to; template<class T> void operator()(T* w) const { Tconstruct::Construct(w,from,to); } };
+      struct destruct { Tidx from,to; template<class T> void operator()(T* w) const { Tconstruct::Destruct(w,from,to); } };
+      struct copy_at { Tidx at,n; template<class T> void operator()(T* w,T* u) const { Tconstruct::Copy(w+at,static_cast<const T*>(u),n); } };
+      struct move_at { Tidx at,n; template<class T> void operator()(T* w,T* u) const { Tconstruct::Move(w+at,u,n); } };
+
+      void Grow(Tidx nN) { reserve(MZ_max(nN,Tnextsize().nextsize(N))); }
+      inli void CopyFrom(const basic_soa_lot& l) {
+        resize(l.N);
+        tuple<Ts*...> from = l.cols;
+        Each(columns(),copy_at{0,N},cols,from);
+      }
+      template<size_t... K> inli void Store(soa_index<K...>,Tidx i,const Ts&... xs) {
+        int d[] = { 0, (std::get<K>(cols)[i] = xs, 0)... };
+        (void)d;
+      }
+      template<class L,class S,size_t... K> void Gather(soa_index<K...>,const L& l,Ts S::*... m) {
+        int d[] = { 0, (GatherColumn(std::get<K>(cols),l,m), 0)... };
+        (void)d;
+      }
+      template<class T,class L,class S> void GatherColumn(T* w,const L& l,T S::* m) { for (Tidx i = 0; i < N; i++) w[i] = l[i].*m; }
+      template<class L,class S,size_t... K> void Scatter(soa_index<K...>,L& l,Ts S::*... m) const {
+        int d[] = { 0, (ScatterColumn(std::get<K>(cols),l,m), 0)... };
+        (void)d;
+      }
+      template<class T,class L,class S> void ScatterColumn(const T* u,L& l,T S::* m) const { for (Tidx i = 0; i < N; i++) l[i].*m = u[i]; }
+    public:
+      // Constructors etc...
+      inli ~basic_soa_lot() { Free(); }
+      inli basic_soa_lot():N(0),cap(0),block(nullptr) {}
+      inli explicit basic_soa_lot(const Talloc& a):Talloc(a),N(0),cap(0),block(nullptr) {}
+      inli basic_soa_lot(Tidx startN,const Talloc& a = Talloc()):Talloc(a),N(0),cap(0),block(nullptr) { resize(startN); }
+      inli basic_soa_lot(const basic_soa_lot& l):basic_soa_lot(l.gAlloc()) { CopyFrom(l); }
+      inli basic_soa_lot& operator=(const basic_soa_lot& l) { if (this != &l) CopyFrom(l); return *this; }
+      inli basic_soa_lot(basic_soa_lot&& l):Talloc(std::move(l.gAlloc())),N(l.N),cap(l.cap),block(l.block),cols(l.cols) { // Takes the memory along with the policy, like the move constructor of lot (swap would also swap the policies back)
+        l.N = 0; l.cap = 0; l.block = nullptr; l.cols = tuple<Ts*...>();
+      }
+      inli basic_soa_lot& operator=(basic_soa_lot&& l) { // The memory of this lot is released by l
+        swap(l);
+        l.clear();
+        return *this;
+      }
+
+      inli Talloc& gAlloc() { return *this; }
+      inli const Talloc& gAlloc() const { return *this; }
+
+      // Element access
+      template<size_t K> inli col_type<K>* data() { return std::get<K>(cols); } // Column K, for loops over one field
+      template<size_t K> inli const col_type<K>* data() const { return std::get<K>(cols); }
+      template<size_t K> inli col_type<K>* aligned_data() { // Same as data<K>(), but tells the compiler about the alignment
+      #  if defined(__GNUC__)
+        return static_cast<col_type<K>*>(__builtin_assume_aligned(std::get<K>(cols),align));
+      #  else
+        return std::get<K>(cols);
+      #  endif
+      }
+      template<size_t K> inli col_type<K>& get(Tidx i) const {
+        if (Acheck && i >= N) throw out_of_range("Lot access out of range!\n");
+        return std::get<K>(cols)[i];
+      }
+      inli row operator[] (Tidx i) const {
+        if (Acheck && i >= N) throw out_of_range("Lot access out of range!\n");
+        return row(this,i);
+      }
+      inli row front() const { return row(this,0); }
+      inli row back() const { return row(this,N-1); }
+
+      // Iterators
+      inli rowIt begin() const { return rowIt(this,0); }
+      inli rowIt end() const { return rowIt(this,N); }
+
+      // Capacity
+      inli Tidx size() const { return N; }
+      inli Tidx capacity() const { return cap; }
+      static size_t Bytes(Tidx c) { return c ? Offset(sizeof...(Ts),c) : 0; } // Size of the block for c rows
+      void reserve(Tidx ncap, bool allowshrink = false) { // Moves all columns into a new block
+        ncap = MZ_max(ncap, allowshrink ? N : cap);
+        if (ncap == cap) return;
+        if (ncap < cap) Each(columns(),destruct{ncap,cap},cols);
+        Tidx kept = MZ_min(cap,ncap);
+        void* w = nullptr;
+        if (ncap != 0) {
+          w = Tconstruct::zeroed ? this->AllocateZeroed(Bytes(ncap),align) : this->Allocate(Bytes(ncap),align);
+          if (w == nullptr) throw bad_alloc();
+        }
+        tuple<Ts*...> ncols = Columns(columns(),w,ncap);
+        Each(columns(),relocate{kept},ncols,cols);
+        if (kept < ncap) Each(columns(),construct{kept,ncap},ncols);
+        if (block != nullptr) this->Deallocate(block,Bytes(cap),align);
+        block = w;
+        cols = ncols;
+        cap = ncap;
+      }
+      void shrink_to_fit() { reserve(N, true); }
+
+      // Modifiers
+      inli void clear() { N = 0; }
+      inli void pop_back() { resize(N - 1); }
+      inli void resize(Tidx nN) { if (nN > cap) Grow(nN); N = nN; }
+      void swap(basic_soa_lot& other) { // Swaps the memory, including the allocation policy it belongs to
+        std::swap(block, other.block);
+        std::swap(cols, other.cols);
+        std::swap(N, other.N);
+        std::swap(cap, other.cap);
+        std::swap(gAlloc(), other.gAlloc());
+      }
+
+      // More modifiers
+      inli void Add(const Ts&... xs) { // One row
+        resize(N + 1);
+        Store(columns(), N - 1, xs...);
+      }
+      inli void Add(const tuple<Ts...>& t) {
+        resize(N + 1);
+        row(this, N - 1) = t;
+      }
+      void Add(const basic_soa_lot& l) {
+        auto oldN = N, n = l.N; // l may be this lot
+        resize(N + n);
+        tuple<Ts*...> from = l.cols;
+        Each(columns(),copy_at{oldN,n},cols,from);
+      }
+      row AddEmpty() {
+        resize(N + 1);
+        return row(this, N - 1);
+      }
+      void Take(basic_soa_lot& l) { // Appends the rows of l and leaves l empty, swapping the memory if this lot is empty
+        if (&l == this) return;
+        if (N == 0) swap(l);
+        else {
+          auto oldN = N, n = l.N;
+          resize(N + n);
+          Each(columns(),move_at{oldN,n},cols,l.cols);
+        }
+        l.clear();
+      }
+      void Free() {
+        clear();
+        reserve(0, true);
+      }
+
+      // Conversion from and to lots (or any container with size, resize and operator[]) of structs, with one member pointer per column: soa.FromLot(particles, &Particle::x, &Particle::v)
+      template<class L,class S> void FromLot(const L& l,Ts S::*... m) {
+        resize(static_cast<Tidx>(l.size()));
+        Gather(columns(), l, m...);
+      }
+      template<class L,class S> void ToLot(L& l,Ts S::*... m) const {
+        l.resize(N);
+        Scatter(columns(), l, m...);
+      }
+    };
+
+    template<class... Ts> using soa_lot = basic_soa_lot<tuple<Ts...>>;
+
+  }
+}
@@ -1,5 +1,24 @@
 #define useCPU
 #include "mz/lot.h"
+#include "mz/small_lot.h"
+#include "mz/lot_parallel.h"
+#include "mz/segmented_lot.h"
+#include "mz/concurrent_lot.h"
+#include "mz/lot_collector.h"
+#include "mz/lot_simd.h"
+#include "mz/soa_lot.h"
+#include "mz/packed_lot.h"
+#include "mz/lot_stats.h"
+#include "mz/lot_registry.h"
+#include "mz/lot_sites.h"
+#include "mz/lot_trace.h"
+#ifdef __linux__
+#  include "mz/mmap_lot.h"
+#endif
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdint>
 using namespace std;
 using namespace std::mz;
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
@@ -41,6 +60,15 @@ TEST_CASE("lot", "Various tests of the functionality of 'lot'") {
     REQUIRE(A.capacity()==0);
   }
 
+  SECTION("Growth and shrinking keep the content") {
+    for (int i = 0; i < 100000; i++) A.Add(i);
+    A.reserve(1 << 22);
+    REQUIRE(A[99999] == 99999);
+    A.shrink_to_fit();
+    REQUIRE(A.capacity() == 100000);
+    REQUIRE(A[12345] == 12345);
+  }
+
   SECTION("Copy and Move") {
     lot<int> B = { 1,2,3,4 };
     A = B;
@@ -81,6 +109,1253 @@ TEST_CASE("lot", "Various tests of the functionality of 'lot'") {
   }
 }
 
+TEST_CASE("lot_relocation", "Growth of lots whose elements can not be moved with memcpy") {
+  lot<string> A;
+  for (int i = 0; i < 100; i++) A.Add(to_string(i));
+  REQUIRE(A[3] == "3");
+  A.reserve(1000);
+  REQUIRE(A[99] == "99");
+  A.shrink_to_fit();
+  REQUIRE(A.capacity() == 100);
+  REQUIRE(A[42] == "42");
+  lot<lot<int>> B;
+  for (int i = 0; i < 20; i++) B.Add(lot<int>{ i,i+1 });
+  REQUIRE(B[17][1] == 18);
+}
+
+struct counting_alloc: lot_malloc { // Stateful allocation policy, which counts live blocks in an external counter
+  int* live;
+  counting_alloc(int* l): live(l) {}
+  void* Allocate(size_t bytes, size_t align) { ++*live; return lot_malloc::Allocate(bytes, align); }
+  void Deallocate(void* p, size_t bytes, size_t align) { --*live; lot_malloc::Deallocate(p, bytes, align); }
+};
+
+struct handing_alloc: counting_alloc { // Leaves no counter behind when it is moved, like policies which own an arena or a pool
+  handing_alloc(int* l): counting_alloc(l) {}
+  handing_alloc(const handing_alloc&) = default;
+  handing_alloc(handing_alloc&& a): counting_alloc(a.live) { a.live = nullptr; }
+  handing_alloc& operator=(const handing_alloc&) = default;
+  handing_alloc& operator=(handing_alloc&& a) { live = a.live; a.live = nullptr; return *this; }
+};
+
+TEST_CASE("lot_alloc", "Stateful and slack claiming allocation policies") {
+  typedef lot<int, Acheck_def, ui32, lot_nextsize<ui32>, counting_alloc> clot;
+  int liveA = 0, liveB = 0;
+  {
+    clot A((counting_alloc(&liveA)));
+    A.Add(1, 2, 3);
+    REQUIRE(liveA == 1);
+    clot B(move(A));
+    REQUIRE(B.gAlloc().live == &liveA);
+    clot C((counting_alloc(&liveB)));
+    C.Add(5);
+    REQUIRE(liveB == 1);
+    C = move(B);
+    REQUIRE(C.gAlloc().live == &liveA);
+    REQUIRE(B.gAlloc().live == &liveB);
+    REQUIRE(C[2] == 3);
+    clot D(C);
+    REQUIRE(D.gAlloc().live == &liveA);
+    REQUIRE(liveA == 2);
+  }
+  REQUIRE(liveA == 0);
+  REQUIRE(liveB == 0);
+  {
+    typedef segmented_lot<int, 4, Acheck_def, ui32, handing_alloc> hseg;
+    hseg G((handing_alloc(&liveA)));
+    G.Add(1, 2, 3);
+    hseg H(move(G));
+    REQUIRE(H.gAlloc().live == &liveA); // The policy stays with the memory
+    REQUIRE(H[2] == 3);
+    typedef basic_soa_lot<tuple<int, float>, Acheck_def, ui32, lot_nextsize<ui32>, handing_alloc> hsoa;
+    hsoa S((handing_alloc(&liveB)));
+    S.Add(1, 2.f);
+    hsoa T(move(S));
+    REQUIRE(T.gAlloc().live == &liveB);
+    REQUIRE(T.get<1>(0) == 2.f);
+  }
+  REQUIRE(liveA == 0);
+  REQUIRE(liveB == 0);
+  REQUIRE(sizeof(lot<int>) == sizeof(int*) + 2 * sizeof(ui32));
+
+  lot<char, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc_usable> U;
+  U.reserve(3);
+  REQUIRE(U.capacity() >= 3);
+  for (int i = 0; i < 100; i++) U.Add(static_cast<char>(i));
+  REQUIRE(U[99] == 99);
+}
+
+TEST_CASE("lot_align", "Over-aligned storage") {
+  typedef lot<float, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, 64> alot;
+  alot A;
+  bool aligned = true;
+  for (int i = 0; i < 10000; i++) {
+    A.Add(static_cast<float>(i));
+    aligned = aligned && reinterpret_cast<uintptr_t>(A.data()) % 64 == 0;
+  }
+  REQUIRE(aligned);
+  REQUIRE(A.aligned_data() == A.data());
+  A.resize(10);
+  A.shrink_to_fit();
+  REQUIRE(reinterpret_cast<uintptr_t>(A.data()) % 64 == 0);
+  REQUIRE(A[9] == 9.f);
+  alot B(move(A));
+  REQUIRE(reinterpret_cast<uintptr_t>(B.data()) % 64 == 0);
+  lot<char, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc_usable, 4096> C = { 'a','b' };
+  REQUIRE(reinterpret_cast<uintptr_t>(C.data()) % 4096 == 0);
+  REQUIRE(C[1] == 'b');
+  lot_malloc m;
+  void* p = m.Allocate(100, 64);
+  memset(p, 7, 100);
+  REQUIRE(m.Reallocate(p, 100, ~size_t(0) >> 2, 64) == nullptr); // Fails, and keeps p
+  REQUIRE(static_cast<char*>(p)[99] == 7);
+  m.Deallocate(p, 100, 64);
+}
+
+struct reserve_counter: lot_nohooks { // Test hook
+  static int calls;
+  void OnReserve(const lot_reserve_event&) { calls++; }
+};
+int reserve_counter::calls = 0;
+
+TEST_CASE("lot_stats", "Growth statistics hooks") {
+  typedef lot<int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_stats> slot;
+  typedef lot<string, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(string), lot_construct_trivial, lot_stats> sslot;
+  REQUIRE(sizeof(lot<int>) == sizeof(int*) + 2 * sizeof(ui32)); // lot_nohooks takes no space
+  REQUIRE(string(lot_type_name<int>()) == "int");
+  lot_stats_global& g = lot_stats::Global();
+  g.Reset();
+  {
+    slot A;
+    for (int i = 0; i < 1000; i++) A.Add(i);
+    REQUIRE(A.gHooks().grows > 5);
+    REQUIRE(A.gHooks().reserves == A.gHooks().grows);
+    REQUIRE(A.gHooks().peakCap == A.capacity());
+    REQUIRE(A.gHooks().Slack() == A.capacity() - 1000);
+    REQUIRE(g.usedBytes == 4000);
+    REQUIRE(g.capacityBytes == 4 * static_cast<long long>(A.capacity()));
+    sslot S(10);
+    REQUIRE(S.gHooks().constructed == 10);
+    S.reserve(100);
+    REQUIRE(S.gHooks().copiedBytes == 10 * sizeof(string)); // Always moved to new memory
+    REQUIRE(S.gHooks().constructed == 100);
+    S.shrink_to_fit();
+    REQUIRE(S.gHooks().destructed == 90);
+    slot B(move(A)); // Moves keep the global sums
+    REQUIRE(g.usedBytes == 4000 + 10 * static_cast<long long>(sizeof(string)));
+    A = move(B);
+    A.clear();
+    REQUIRE(g.usedBytes == 10 * static_cast<long long>(sizeof(string)));
+    REQUIRE(g.peakCapacityBytes >= g.capacityBytes);
+  }
+  REQUIRE(g.capacityBytes == 0);
+  REQUIRE(g.usedBytes == 0);
+  REQUIRE(g.growLatency.Count() == g.grows);
+  REQUIRE(g.destructed == g.constructed);
+  REQUIRE(g.Json().find("\"growLatencyNs\":{\"count\":") != string::npos);
+  SECTION("Histogram") {
+    lot_histogram h;
+    for (unsigned long long x = 1; x <= 1000; x++) h.Record(x);
+    REQUIRE(h.Count() == 1000);
+    REQUIRE(h.Max() == 1000);
+    REQUIRE(h.Percentile(0.5) >= 500);
+    REQUIRE(h.Percentile(0.5) <= 532); // Within the 6.25% of a bucket
+    REQUIRE(h.Percentile(1) == 1000);
+    bool ok = true;
+    for (unsigned long long x : { 0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, ~0ull }) {
+      unsigned b = lot_histogram::Bucket(x);
+      ok = ok && lot_histogram::Lowest(b) <= x && x <= lot_histogram::Highest(b);
+    }
+    REQUIRE(ok);
+  }
+  SECTION("Combined hooks") {
+    lot<int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_hooks<lot_stats, reserve_counter>> C;
+    reserve_counter::calls = 0;
+    C.Add(1, 2, 3);
+    C.Free();
+    REQUIRE(reserve_counter::calls == 2);
+    REQUIRE(C.gHooks().reserves == 2);
+  }
+}
+
+TEST_CASE("lot_registry", "Registry of the living lots") {
+  typedef lot<int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_registered> rlot;
+  typedef lots<adapter_malloc<int>, int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_registered> rlots;
+  size_t before = lot_registry::Snapshot().lots;
+  {
+    rlot A, B, C;
+    A.gHooks().Tag("cache");
+    A.resize(1000);
+    A.clear(); // The memory stays as slack
+    B.Add(1, 2, 3);
+    lot_registry::snapshot s = lot_registry::Snapshot(1);
+    REQUIRE(s.lots == before + 2); // C has no memory
+    REQUIRE(s.top.size() == 1);
+    REQUIRE(string(s.top[0].tag) == "cache");
+    REQUIRE(string(s.top[0].type) == "int");
+    REQUIRE(s.top[0].SlackBytes() == A.capacity() * sizeof(int));
+    REQUIRE(s.slackBytes >= s.top[0].SlackBytes());
+    REQUIRE(s.groups.size() == 1);
+    REQUIRE(s.Json().find("\"tag\":\"cache\"") != string::npos);
+    A.Free();
+    rlot D(move(B));
+    REQUIRE(lot_registry::Snapshot().lots == before + 1);
+    rlots E = { 1,2,3 };
+    E.DevFromHost();
+    s = lot_registry::Snapshot();
+    REQUIRE(s.devBytes >= E.capacity() * sizeof(int));
+    E.DevFree();
+    REQUIRE(lot_registry::Snapshot().devBytes == s.devBytes - E.capacity() * sizeof(int));
+    E.DevFromHost(); // Creates the device memory again
+    REQUIRE(E.gDevCapacity() == E.capacity());
+  }
+  REQUIRE(lot_registry::Snapshot().lots == before);
+  {
+    struct spaced { rlot l; char pad[4096 - sizeof(rlot)]; }; // 4096 bytes apart, so in the same shard
+    spaced S[2];
+    rlot &A = S[0].l, &B = S[1].l;
+    A.resize(10);
+    B.resize(10);
+    A.Free();
+    A.resize(10); // Linked again as the head of the shard
+    A.Free();
+    REQUIRE(lot_registry::Snapshot().lots == before + 1);
+    B.Free();
+    A.resize(10);
+    REQUIRE(lot_registry::Snapshot().lots == before + 1);
+  }
+  REQUIRE(lot_registry::Snapshot().lots == before);
+  SECTION("Concurrent lots and dumps") {
+    const char* path = "/tmp/mz_lot_registry_test.jsonl";
+    remove(path);
+    lot_registry::StartDumps(path, 1);
+    vector<thread> t;
+    for (int k = 0; k < 4; k++) t.emplace_back([]() {
+      for (int i = 0; i < 2000; i++) {
+        rlot L(static_cast<ui32>(i % 50 + 1));
+        rlot M(L);
+      }
+    });
+    for (int i = 0; i < 20; i++) lot_registry::Snapshot();
+    for (auto& x : t) x.join();
+    this_thread::sleep_for(chrono::milliseconds(5));
+    lot_registry::StopDumps();
+    REQUIRE(lot_registry::Snapshot().lots == before);
+    REQUIRE(lot_registry::Dump(path));
+    FILE* f = fopen(path, "r");
+    REQUIRE(f != nullptr);
+    int lines = 0;
+    for (int c = fgetc(f); c != EOF; c = fgetc(f)) lines += c == '\n';
+    fclose(f);
+    remove(path);
+    REQUIRE(lines >= 2);
+  }
+}
+
+TEST_CASE("lot_sites", "Growth by call site") {
+  typedef lot<int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_sites> slot;
+  lot_site_profile::Reset();
+  int line;
+  {
+    line = __LINE__; MZ_LOT_SITE;
+    slot A;
+    for (int i = 0; i < 1000; i++) A.Add(i);
+    REQUIRE(lot_site_scope::Current() != nullptr);
+  }
+  REQUIRE(lot_site_scope::Current() == nullptr);
+  {
+    slot B;
+    B.reserve(100); // Attributed to the return address
+  }
+  vector<lot_site_profile::site_stats> sites = lot_site_profile::Sites();
+  REQUIRE(sites.size() >= 2); // The reserve and the Free of B have their own return addresses, unless reserve was inlined
+  REQUIRE(sites[0].site != nullptr);
+  REQUIRE(sites[0].site->line == line);
+  REQUIRE(sites[0].grows > 5);
+  REQUIRE(sites[0].allocBytes > 4000);
+  REQUIRE(sites[0].reserves == sites[0].grows + 1); // And the Free in the destructor
+  unsigned long long grows = 0, allocBytes = 0, reserves = 0;
+  for (size_t i = 1; i < sites.size(); i++) {
+    REQUIRE(sites[i].site == nullptr);
+    REQUIRE(!sites[i].Name().empty());
+    grows += sites[i].grows;
+    allocBytes += sites[i].allocBytes;
+    reserves += sites[i].reserves;
+  }
+  REQUIRE(grows == 1);
+  REQUIRE(allocBytes == 400);
+  REQUIRE(reserves == 2);
+  string folded = lot_site_profile::Folded();
+  REQUIRE(folded.find("lot;") == 0);
+  REQUIRE(folded.find("main.cpp:" + to_string(line)) != string::npos);
+  string pprof = lot_site_profile::Pprof();
+  REQUIRE(pprof.find("heap profile: ") == 0);
+  REQUIRE(pprof.find("MAPPED_LIBRARIES:") != string::npos);
+}
+
+static size_t count_of(const string& s, const string& what) {
+  size_t n = 0;
+  for (size_t i = s.find(what); i != string::npos; i = s.find(what, i + 1)) n++;
+  return n;
+}
+
+TEST_CASE("lot_trace", "Timeline of growth and device transfers") {
+  typedef lot<int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_trace> tlot;
+  typedef lots<adapter_malloc<int>, int, true, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_trivial, lot_trace> tlots;
+  lot_trace_log::Clear();
+  {
+    tlot A;
+    A.reserve(100);
+    A.Free();
+    A.Free(); // Without memory, nothing happens
+    tlots E = { 1,2,3 };
+    E.DevFromHost();
+    E.HostFromDev();
+  }
+  string j = lot_trace_log::Json();
+  REQUIRE(j.find("{\"traceEvents\":[") == 0);
+  REQUIRE(count_of(j, "\"ph\":\"B\"") == count_of(j, "\"ph\":\"E\""));
+  REQUIRE(count_of(j, "\"name\":\"Free\",\"cat\":\"lot\",\"ph\":\"B\"") == 2); // A, and E at the end
+  REQUIRE(count_of(j, "\"name\":\"DevReserve\"") == 2); // Created by DevFromHost
+  REQUIRE(count_of(j, "\"name\":\"DevFromHost\"") == 2);
+  REQUIRE(count_of(j, "\"name\":\"HostFromDev\"") == 2);
+  REQUIRE(j.find("\"args\":{\"type\":\"int\"}") != string::npos);
+  REQUIRE(j.find("\"args\":{\"bytes\":400}") != string::npos);
+  REQUIRE(j.find("\"args\":{\"bytes\":" + to_string(3 * sizeof(int)) + "}") != string::npos);
+  REQUIRE(lot_trace_log::Json().find("\"ph\"") == string::npos); // Flushed
+  SECTION("Threads and lost events") {
+    unsigned long long lost = lot_trace_log::Lost();
+    vector<thread> t;
+    for (int k = 0; k < 2; k++) t.emplace_back([]() {
+      for (int i = 0; i < 100; i++) tlot L(static_cast<ui32>(i + 1));
+    });
+    for (auto& x : t) x.join();
+    j = lot_trace_log::Json();
+    REQUIRE(count_of(j, "\"name\":\"reserve\"") == 2 * 2 * 200);
+    REQUIRE(lot_trace_log::Lost() == lost);
+    for (size_t i = 0; i < 2 * lot_trace_log::events; i++) lot_trace_log::Record(lot_op_reserve, i % 2 == 0, &lot_type_name<int>, i);
+    string out;
+    REQUIRE(lot_trace_log::Flush(out) == lot_trace_log::events - 1); // The oldest slot might have been in the middle of being overwritten
+    REQUIRE(lot_trace_log::Lost() == lost + lot_trace_log::events + 1);
+    REQUIRE(out.find("\"bytes\":" + to_string(2 * lot_trace_log::events - 1) + "}") != string::npos);
+  }
+  SECTION("Rings of ended threads are reused") {
+    thread([]() { tlot L(1); }).join();
+    size_t rings = lot_trace_log::Rings();
+    for (int k = 0; k < 10; k++) thread([]() { tlot L(1); }).join();
+    REQUIRE(lot_trace_log::Rings() == rings);
+    j = lot_trace_log::Json();
+    REQUIRE(count_of(j, "\"name\":\"reserve\"") == 2 * 2 * 11); // Nothing lost
+    REQUIRE(j.find("[\n,") == string::npos);
+    REQUIRE(j.find(",\n,") == string::npos);
+  }
+}
+
+#if defined(MZ_LOT_USDT) && defined(__linux__)
+TEST_CASE("lot_usdt", "Static probes in the binary") {
+  string exe;
+  FILE* f = fopen("/proc/self/exe", "rb");
+  REQUIRE(f != nullptr);
+  char buf[65536];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) != 0;) exe.append(buf, n);
+  fclose(f);
+  for (const char* probe : { "reserve_begin", "reserve_end", "free", "take", "dev_reserve_begin", "dev_reserve_end", "dev_from_host_begin", "host_from_dev_end" }) {
+    INFO(probe);
+    REQUIRE(exe.find(string("mz_lot") + '\0' + probe + '\0') != string::npos); // Provider and name, in the .note.stapsdt section
+  }
+}
+#endif
+
+#ifdef __linux__
+#include <cstdarg>
+#include <sys/syscall.h>
+static bool mremap_like_hugetlb = false; // mremap fails like for hugetlb pages on kernels before 5.16, which unmap the target of MREMAP_FIXED first
+
+extern "C" void* mremap(void* p, size_t oldbytes, size_t bytes, int flags, ...) __THROW { // Replaces the one of libc for lot_hugepage
+  void* to = nullptr;
+  if (flags & MREMAP_FIXED) {
+    va_list args;
+    va_start(args, flags);
+    to = va_arg(args, void*);
+    va_end(args);
+  }
+  if (mremap_like_hugetlb) {
+    if (flags & MREMAP_FIXED) munmap(to, bytes);
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+  return reinterpret_cast<void*>(syscall(SYS_mremap, p, oldbytes, bytes, flags, to));
+}
+
+TEST_CASE("lot_hugepage", "Large lots in 2 MiB aligned, huge page backed memory") {
+  lot<float, Acheck_def, ui32, lot_nextsize<ui32>, lot_hugepage<>> A;
+  SECTION("Small lots stay on the heap") {
+    A.reserve(10);
+    REQUIRE(A.capacity() == 10);
+    REQUIRE(lot_backing_of(A).kind == lot_backing::heap);
+  }
+  SECTION("Capacity is rounded up to whole huge pages") {
+    A.reserve(1 << 20);
+    REQUIRE(A.capacity() == 1 << 20);
+    A.reserve((1 << 20) + 1);
+    REQUIRE(A.capacity() == 3 << 19);
+    REQUIRE(reinterpret_cast<uintptr_t>(A.data()) % lot_hugepage_size == 0);
+    REQUIRE(lot_backing_of(A).kind != lot_backing::heap);
+  }
+  SECTION("Growth and shrinking keep the content") {
+    for (int i = 0; i < 3000000; i++) A.Add(static_cast<float>(i));
+    REQUIRE(A[2999999] == 2999999.f);
+    REQUIRE(reinterpret_cast<uintptr_t>(A.data()) % lot_hugepage_size == 0);
+    A.resize(1000);
+    A.shrink_to_fit();
+    REQUIRE(A.capacity() == 1000);
+    REQUIRE(A[999] == 999.f);
+    A.Free();
+    REQUIRE(lot_backing_of(A).kind == lot_backing::none);
+  }
+  SECTION("Pages which mremap cannot move are copied") {
+    A.resize(1 << 20); // 4 MiB
+    for (ui32 i = 0; i < A.size(); i++) A[i] = static_cast<float>(i);
+    mremap_like_hugetlb = true;
+    A.resize(3 << 20);
+    mremap_like_hugetlb = false;
+    REQUIRE(reinterpret_cast<uintptr_t>(A.data()) % lot_hugepage_size == 0);
+    bool same = true;
+    for (ui32 i = 0; i < 1 << 20; i++) same = same && A[i] == static_cast<float>(i);
+    REQUIRE(same);
+    REQUIRE(A[(3 << 20) - 1] == 0.f);
+  }
+}
+#endif
+
+struct counted { // Counts its live instances
+  static int live;
+  int x;
+  counted(): x(0) { live++; }
+  counted(const counted& c): x(c.x) { live++; }
+  ~counted() { live--; }
+  counted& operator=(const counted&) = default;
+};
+int counted::live = 0;
+
+#ifdef __linux__
+static size_t resident_pages() {
+  size_t total = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%zu %zu", &total, &resident) != 2) resident = 0;
+    fclose(f);
+  }
+  return resident;
+}
+#endif
+
+TEST_CASE("lot_construct", "Construction policies") {
+  SECTION("Eager construction constructs the whole capacity") {
+    {
+      lot<counted, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(counted), lot_construct_eager> A;
+      A.reserve(10);
+      REQUIRE(counted::live == 10);
+      A.resize(3);
+      A.reserve(5, true);
+      REQUIRE(counted::live == 5);
+      A.Free();
+      REQUIRE(counted::live == 0);
+      A.resize(7);
+    }
+    REQUIRE(counted::live == 0);
+    {
+      lot<counted> B(4); // Non-trivial types are still constructed by the default policy
+      REQUIRE(counted::live == 4);
+    }
+    REQUIRE(counted::live == 0);
+  }
+  SECTION("Zero construction") {
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_zero> A;
+    int sum = 0;
+    for (ui32 n = 1; n < 100000; n *= 3) {
+      A.resize(n);
+      for (ui32 i = n / 3; i < n; i++) sum += A[i];
+    }
+    REQUIRE(sum == 0);
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc_usable, 64, lot_construct_zero> U;
+    U.resize(5);
+    U.resize(U.capacity());
+    REQUIRE(U[U.size() - 1] == 0);
+    lot<lot<int>, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(lot<int>), lot_construct_zero> L(100);
+    L[99].Add(1, 2);
+    L.reserve(1000);
+    REQUIRE(L[99][1] == 2);
+    REQUIRE(L[500].size() == 0);
+    REQUIRE(lot_zero_constructible<lot<int>>::value);
+    REQUIRE(!lot_zero_constructible<string>::value);
+  }
+#ifdef __linux__
+  SECTION("Reserving memory does not fault it in") {
+    size_t before = resident_pages();
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_zero> A;
+    A.resize(64 << 20);
+    lot<int> B;
+    B.reserve(64 << 20);
+    REQUIRE(A[12345678] == 0);
+    REQUIRE(resident_pages() - before < (16u << 20) / 4096);
+  }
+#endif
+}
+
+#ifdef __linux__
+TEST_CASE("lot_vmreserve", "Lots which grow in place in reserved address space") {
+  typedef lot_vmreserve<size_t(1) << 30, size_t(64) << 10> vm;
+  SECTION("Growth never moves") {
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, vm> A;
+    A.reserve(1);
+    REQUIRE(A.capacity() == 16384);
+    int* mem = A.data();
+    bool stable = true;
+    for (int i = 0; i < 5000000; i++) {
+      A.Add(i);
+      stable = stable && A.data() == mem;
+    }
+    REQUIRE(stable);
+    REQUIRE(A[4999999] == 4999999);
+    REQUIRE_THROWS_AS(A.reserve(ui32(1) << 30), bad_alloc);
+    REQUIRE(A.data() == mem);
+  }
+  SECTION("Shrinking gives the memory back") {
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, vm, 4096, lot_construct_zero> A(16 << 20);
+    for (ui32 i = 0; i < A.size(); i++) A[i] = 1;
+    size_t full = resident_pages();
+    A.resize(10);
+    A.shrink_to_fit();
+    REQUIRE(A.capacity() == 16384);
+    REQUIRE(full - resident_pages() > (32u << 20) / 4096);
+    A.resize(A.capacity());
+    REQUIRE(A[11] == 0);
+    A.resize(1 << 20);
+    REQUIRE(A[(1 << 20) - 1] == 0);
+    REQUIRE(A[9] == 1);
+  }
+  SECTION("Non-relocatable types and alignment") {
+    lot<string, Acheck_def, ui32, lot_nextsize<ui32>, vm> S;
+    S.Add(string("first, long enough for the heap"));
+    string* mem = S.data();
+    for (int i = 0; i < 100000; i++) S.Add(to_string(i));
+    REQUIRE(S.data() == mem);
+    REQUIRE(S[0] == "first, long enough for the heap");
+    lot<float, Acheck_def, ui32, lot_nextsize<ui32>, vm, lot_hugepage_size> F(10);
+    REQUIRE(reinterpret_cast<uintptr_t>(F.data()) % lot_hugepage_size == 0);
+    REQUIRE(lot_backing_of(F).kind != lot_backing::heap);
+  }
+}
+#endif
+
+#ifdef __linux__
+struct record { ui64 id; double value; char tag[16]; };
+
+TEST_CASE("mmap_lot", "Lots in memory mapped files") {
+  string path = "/tmp/mz_mmap_lot_test_" + to_string(getpid()) + ".lot";
+  SECTION("Save, reopen and grow") {
+    {
+      mmap_lot<record> F(path.c_str(), lot_map::create);
+      REQUIRE(F.IsWritable());
+      for (ui64 i = 0; i < 100000; i++) F.Add(record{ i, double(i) / 2, "record" });
+      REQUIRE(F.size() == 100000);
+      REQUIRE(F.capacity() >= F.size());
+      F.Sync();
+    }
+    {
+      mmap_lot<record> R(path.c_str(), lot_map::readonly | lot_map::willneed);
+      const mmap_lot<record>& C = R;
+      REQUIRE(C.size() == 100000);
+      REQUIRE(C[99999].id == 99999);
+      REQUIRE(string(C[5].tag) == "record");
+      REQUIRE(C.back().id == 99999);
+      REQUIRE_THROWS_AS(R.Add(record{ 0, 0, "" }), logic_error);
+      REQUIRE_THROWS_AS(R[0].id = 1, logic_error); // The pages are read-only
+      REQUIRE_THROWS_AS(R.data(), logic_error);
+      REQUIRE_THROWS_AS(R.begin(), logic_error);
+      REQUIRE(C[0].id == 0);
+    }
+    {
+      mmap_lot<record> W(path.c_str(), lot_map::populate);
+      REQUIRE(W.size() == 100000);
+      record* r = W.AddEmpty();
+      r->id = 7;
+      lot<record> more(1000);
+      for (ui32 i = 0; i < more.size(); i++) more[i] = record{ 100001 + i, 0, "bulk" };
+      W.Add(more.data(), more.size());
+      REQUIRE(W.size() == 101001);
+      REQUIRE(W[100000].id == 7);
+      W.resize(100500);
+    }
+    mmap_lot<record> R(path.c_str(), lot_map::readonly);
+    REQUIRE(R.size() == 100500);
+    REQUIRE(string(static_cast<const mmap_lot<record>&>(R)[100499].tag) == "bulk");
+    R.Close();
+    REQUIRE(!R.IsOpen());
+  }
+  SECTION("Type and format checks") {
+    { mmap_lot<record> F(path.c_str(), lot_map::create); F.Add(record{ 1, 2, "x" }); }
+    REQUIRE_THROWS_AS(mmap_lot<double>(path.c_str(), lot_map::readonly), runtime_error);
+    { mmap_lot<ui64> F(path.c_str(), lot_map::create); F.Add(1); }
+    REQUIRE_THROWS_AS(mmap_lot<double>(path.c_str(), lot_map::readonly), runtime_error); // Same size, another name
+    REQUIRE(mmap_lot<ui64>(path.c_str(), lot_map::readonly).size() == 1);
+    { mmap_lot<record> F(path.c_str(), lot_map::create); F.Add(record{ 1, 2, "x" }); }
+    REQUIRE_THROWS_AS(mmap_lot<record>("/nonexistent/dir/file.lot", lot_map::readonly), system_error);
+    mmap_lot<record> A(path.c_str()), B;
+    B = std::move(A);
+    REQUIRE(!A.IsOpen());
+    REQUIRE(B.size() == 1);
+  }
+  unlink(path.c_str());
+}
+#endif
+
+TEST_CASE("lot_copy", "Bulk copies") {
+  SECTION("Non-temporal copies of any size and alignment") {
+    lot<unsigned char> src(1000), dst(1000);
+    for (ui32 i = 0; i < src.size(); i++) src[i] = static_cast<unsigned char>(i * 7);
+    bool same = true;
+    for (ui32 off = 0; off < 20; off++)
+      for (ui32 bytes = 0; bytes < 300; bytes += 13) {
+        memset(dst.data(), 0, dst.size());
+        lot_memcpy_stream(dst.data() + off, src.data() + 3, bytes);
+        same = same && memcmp(dst.data() + off, src.data() + 3, bytes) == 0 && dst[off + bytes] == 0;
+      }
+    REQUIRE(same);
+  }
+  SECTION("Copy, append and self-append") {
+    lot<int> A = { 1,2,3 };
+    lot<int> B(A);
+    B.Add(B);
+    REQUIRE(B.size() == 6);
+    REQUIRE(B[5] == 3);
+    lot<string> S = { "a", "b" };
+    lot<string> T;
+    T = S;
+    T.Add(S);
+    REQUIRE(T[3] == "b");
+    small_lot<string, 2> U = { "c" };
+    U.Add(U);
+    U.Add(U);
+    REQUIRE(U.size() == 4);
+    REQUIRE(U[3] == "c");
+  }
+  SECTION("Parallel copies") {
+    typedef lot_construct_parallel<1000> par;
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), par> A(50000), B;
+    for (ui32 i = 0; i < A.size(); i++) A[i] = static_cast<int>(i);
+    B = A;
+    B.Add(A);
+    REQUIRE(B[49999] == 49999);
+    REQUIRE(B[99999] == 49999);
+    lot<string, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(string), par> S(5000), T;
+    S[4999] = "last";
+    T = S;
+    REQUIRE(T[4999] == "last");
+  }
+}
+
+TEST_CASE("lot_take", "Take steals memory where possible") {
+  SECTION("Into an empty lot") {
+    lot<int> A, B = { 1,2,3 };
+    A.reserve(10);
+    int* mem = B.data();
+    A.Take(B);
+    REQUIRE(A.data() == mem);
+    REQUIRE(A.size() == 3);
+    REQUIRE(A[2] == 3);
+    REQUIRE(B.size() == 0);
+    REQUIRE(B.capacity() == 10); // B keeps the old memory of A for reuse
+  }
+  SECTION("Into a smaller lot") {
+    lot<string> A = { "a","b" }, B;
+    B.reserve(100);
+    B.Add(string("c"), string("d"), string("e"));
+    string* mem = B.data();
+    A.Take(B);
+    REQUIRE(A.data() == mem);
+    REQUIRE(A.size() == 5);
+    REQUIRE(A[0] == "a");
+    REQUIRE(A[1] == "b");
+    REQUIRE(A[4] == "e");
+    REQUIRE(B.size() == 0);
+  }
+  SECTION("Into a larger lot") {
+    lot<lot<int>> A(2), B(1);
+    A.reserve(10);
+    B[0].Add(7);
+    A.Take(B);
+    REQUIRE(A.size() == 3);
+    REQUIRE(A[2][0] == 7);
+    REQUIRE(B.size() == 0);
+    A.Take(A);
+    REQUIRE(A.size() == 3);
+  }
+  SECTION("Swap and small_lot") {
+    lot<int> A = { 1 }, B = { 2,3 };
+    A.swap(B);
+    REQUIRE(A.size() == 2);
+    REQUIRE(B[0] == 1);
+    small_lot<int, 2> S, T = { 1,2,3 };
+    int* mem = T.data();
+    S.Take(T);
+    REQUIRE(S.data() == mem);
+    REQUIRE(T.IsInline());
+    T.Add(4);
+    S.Take(T);
+    REQUIRE(S.size() == 4);
+    REQUIRE(S[3] == 4);
+    REQUIRE(T.size() == 0);
+  }
+}
+
+TEST_CASE("lot_parallel", "Parallel construction and destruction") {
+  typedef lot_construct_parallel<1000> par;
+  SECTION("Every element is constructed and destructed once") {
+    {
+      lot<counted, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(counted), par> A;
+      A.reserve(100000);
+      REQUIRE(counted::live == 100000);
+      A.resize(10);
+      A.reserve(20000, true);
+      REQUIRE(counted::live == 20000);
+    }
+    REQUIRE(counted::live == 0);
+  }
+  SECTION("Non-trivial and nested element types") {
+    lot<string, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(string), par> S(50000);
+    REQUIRE(S[49999].empty());
+    for (ui32 i = 0; i < S.size(); i++) S[i] = to_string(i) + " is long enough for the heap";
+    S.reserve(200000);
+    REQUIRE(S[4321] == "4321 is long enough for the heap");
+    lot<lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), par>, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(lot<int>), par> L(5000);
+    lot_parallel_for(ui32(0), L.size(), [&L](ui32 a, ui32 b) { for (ui32 i = a; i < b; i++) L[i].resize(i < 2 ? 2000 : 3); });
+    REQUIRE(L[1].capacity() >= 2000);
+    L.Free();
+    REQUIRE(L.capacity() == 0);
+  }
+  SECTION("First touch and chunking") {
+    lot<int, Acheck_def, ui32, lot_nextsize<ui32>, lot_malloc, alignof(int), lot_construct_parallel<1000, lot_construct_trivial, true>> A(100000);
+    REQUIRE(A[99999] == 0);
+    lot<int> covered(100000);
+    lot_parallel_for(ui32(0), covered.size(), [&covered](ui32 a, ui32 b) { for (ui32 i = a; i < b; i++) covered[i] = 1; }, 1000);
+    int sum = 0;
+    for (int c : covered) sum += c;
+    REQUIRE(sum == 100000);
+    REQUIRE_THROWS_AS(lot_pool::Get().Run(lot_pool::Get().Threads(), [](unsigned t) { if (t + 1 == lot_pool::Get().Threads()) throw out_of_range("worker"); }), out_of_range);
+  }
+  SECTION("Work stealing covers every index once") {
+    lot_pool p(4);
+    vector<atomic<int>> hits(100000);
+    for (auto& h : hits) h.store(0);
+    p.ForDynamic(ui32(0), ui32(hits.size()), 16, [&hits](ui32 a, ui32 b) {
+      for (ui32 i = a; i < b; i++) {
+        if (i < 1000) this_thread::sleep_for(chrono::microseconds(20)); // Irregular work, the other threads have to steal
+        hits[i]++;
+      }
+    });
+    bool once = true;
+    for (auto& h : hits) once = once && h.load() == 1;
+    REQUIRE(once);
+    int empty = 0;
+    p.ForDynamic(5, 5, 1, [&empty](int, int) { empty++; });
+    REQUIRE(empty == 0);
+  }
+  SECTION("parallel_for and parallel_for_ab") {
+    lot<ui32, true> A(10000);
+    parallel_for(A, [](ui32& x, ui32 i) { x = i; });
+    REQUIRE(A[9999] == 9999);
+    atomic<ui64> sum(0);
+    parallel_for_ab(A, 100, 200, [&sum](ui32& x, ui32) { sum += x; });
+    REQUIRE(sum.load() == 14950);
+    REQUIRE_THROWS_AS(parallel_for_ab(A, 0, 10001, [](ui32&, ui32) {}), out_of_range);
+    lot<ui32, false> B(10);
+    int calls = 0;
+    parallel_for_ab(B, 5, 1000, [&calls](ui32&, ui32) { calls++; }); // Clamped
+    REQUIRE(calls == 5);
+    segmented_lot<lot<ui32>> nested(100);
+    parallel_for(nested, [](lot<ui32>& l, ui32 i) {
+      l.resize(i);
+      parallel_for(l, [](ui32& x, ui32 j) { x = j; }); // Runs serially inside the outer loop
+    });
+    REQUIRE(nested[99][98] == 98);
+  }
+}
+
+struct limited_malloc: lot_malloc { // Fails for blocks of more than 4 KiB
+  void* Allocate(size_t bytes, size_t align) { return bytes > 4096 ? nullptr : lot_malloc::Allocate(bytes, align); }
+  void* Reallocate(void* p, size_t oldbytes, size_t bytes, size_t align) { return bytes > 4096 ? nullptr : lot_malloc::Reallocate(p, oldbytes, bytes, align); }
+};
+
+TEST_CASE("concurrent_lot", "Appending from many threads") {
+  SECTION("Every element arrives once, and groups stay together") {
+    concurrent_lot<ui32> A;
+    vector<thread> threads;
+    for (ui32 t = 0; t < 8; t++) threads.emplace_back([&A, t]() {
+      for (ui32 k = 0; k < 20000; k++) {
+        ui32 x = (t << 24) | (k << 2);
+        if (k % 2) A.Add(x, x | 1, x | 2);
+        else A.Add(x);
+      }
+    });
+    for (auto& th : threads) th.join();
+    REQUIRE(A.size() == 8 * 20000 * 2);
+    bool grouped = true;
+    for (ui32 i = 0; i < A.size(); i++)
+      if (A[i] & 3) grouped = grouped && A[i - 1] + 1 == A[i];
+    REQUIRE(grouped);
+    lot<ui32>& L = A.gLot();
+    sort(L.begin(), L.end());
+    REQUIRE(unique(L.begin(), L.end()) == L.end());
+    REQUIRE(L.capacity() >= L.size());
+  }
+  SECTION("Non-trivial types and hand-over") {
+    concurrent_lot<string> S(16);
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) threads.emplace_back([&S, t]() {
+      for (int k = 0; k < 5000; k++) S.AddWith(2, [t, k](string* p) { p[0] = to_string(t); p[1] = to_string(k); });
+    });
+    for (auto& th : threads) th.join();
+    REQUIRE(S.size() == 40000);
+    bool paired = true;
+    for (ui32 i = 0; i < S.size(); i += 2) paired = paired && S[i].size() == 1;
+    REQUIRE(paired);
+    lot<string> more = { "x" };
+    S.Take(more);
+    REQUIRE(S.size() == 40001);
+    S.Add(string("y"));
+    REQUIRE(S[40001] == "y");
+    lot<string> all;
+    all.Take(S.gLot());
+    REQUIRE(all.size() == 40002);
+  }
+  SECTION("A failed allocation leaves the lot usable") {
+    concurrent_lot<ui32, Acheck_def, ui32, lot_nextsize<ui32>, limited_malloc> A(1000);
+    vector<thread> threads;
+    atomic<ui32> failures(0);
+    for (ui32 t = 0; t < 4; t++) threads.emplace_back([&A, &failures]() {
+      for (ui32 k = 0; k < 2000; k++) {
+        try { A.Add(k); }
+        catch (bad_alloc&) { failures++; }
+      }
+    });
+    for (auto& th : threads) th.join();
+    REQUIRE(failures > 0);
+    REQUIRE(A.size() + failures == 8000);
+    REQUIRE(A.size() <= A.capacity());
+    REQUIRE_THROWS_AS(A.Add(1), bad_alloc);
+    A.clear();
+    A.Add(5);
+    REQUIRE(A[0] == 5);
+  }
+}
+
+TEST_CASE("lot_collector", "Per-thread lots, merged at the end") {
+  lot_collector<ui32> C;
+  auto fill = [&C](ui32 threads, ui32 each) {
+    vector<thread> pool;
+    for (ui32 t = 0; t < threads; t++) pool.emplace_back([&C, t, each]() {
+      for (ui32 k = 0; k < each; k++) C.Add((t << 20) | k);
+    });
+    for (auto& th : pool) th.join();
+  };
+  SECTION("All parts arrive in order") {
+    fill(6, 10000);
+    REQUIRE(C.size() == 60000);
+    lot<ui32> A = { 7 };
+    C.gather(A);
+    REQUIRE(A.size() == 60001);
+    REQUIRE(A[0] == 7);
+    bool ordered = true;
+    for (ui32 i = 2; i < A.size(); i++)
+      if ((A[i] >> 20) == (A[i - 1] >> 20)) ordered = ordered && A[i] == A[i - 1] + 1;
+    REQUIRE(ordered);
+    REQUIRE(C.size() == 0);
+    bool kept = true;
+    C.ForEachLocal([&kept](lot<ui32>& l) { kept = kept && (l.capacity() == 0 || l.capacity() >= 10000); });
+    REQUIRE(kept);
+    fill(3, 100);
+    REQUIRE(C.gather().size() == 300);
+    lot<ui32> D(1000);
+    fill(1, 10);
+    C.gather(D);
+    REQUIRE(D.capacity() == 1010); // Grown once, to exactly the total, not by the growth policy
+  }
+  SECTION("Single parts are taken over") {
+    fill(4, 100);
+    lot<ui32> A;
+    C.gather(A); // The other slots keep their capacity
+    A.clear(); // And so does A
+    C.Add(1, 2, 3);
+    ui32* mem = C.Local().data();
+    C.gather(A, false);
+    REQUIRE(A.data() == mem);
+    REQUIRE(A[2] == 3);
+    size_t left = 0;
+    C.ForEachLocal([&left](lot<ui32>& l) { left += l.capacity(); });
+    REQUIRE(left == 0);
+  }
+  SECTION("Non-trivial types") {
+    lot_collector<string> S;
+    vector<thread> pool;
+    for (int t = 0; t < 4; t++) pool.emplace_back([&S, t]() { for (int k = 0; k < 1000; k++) S.Add(to_string(t * 1000 + k)); });
+    for (auto& th : pool) th.join();
+    lot<string> A = S.gather(false);
+    REQUIRE(A.size() == 4000);
+    sort(A.begin(), A.end(), [](const string& a, const string& b) { return stoi(a) < stoi(b); });
+    REQUIRE(A[3999] == "3999");
+  }
+}
+
+TEST_CASE("small_lot", "Various tests of the functionality of 'small_lot'") {
+  small_lot<int, 4> A;
+  REQUIRE(A.capacity() == 4);
+  REQUIRE(A.IsInline());
+
+  SECTION("Spilling to the heap and back") {
+    A.Add(1, 2, 3);
+    REQUIRE(A.IsInline());
+    A.Add(4);
+    A.Add(5);
+    REQUIRE(!A.IsInline());
+    REQUIRE(A[4] == 5);
+    small_lot<int, 4> B(move(A));
+    REQUIRE(B.size() == 5);
+    REQUIRE(A.size() == 0);
+    REQUIRE(A.IsInline());
+    B.resize(2);
+    B.shrink_to_fit();
+    REQUIRE(B.IsInline());
+    REQUIRE(B[1] == 2);
+    B.Free();
+    REQUIRE(B.capacity() == 4);
+  }
+
+  SECTION("Copy, Move and Take") {
+    small_lot<string, 2> S = { "a","b" };
+    small_lot<string, 2> T(S);
+    T.Add(string("c"));
+    S.Take(T);
+    REQUIRE(S.size() == 5);
+    REQUIRE(T.size() == 0);
+    REQUIRE(S[4] == "c");
+    T = move(S);
+    REQUIRE(T[2] == "a");
+    REQUIRE(S.size() == 0);
+    S = { "x" };
+    T = move(S);
+    REQUIRE(T.size() == 1);
+    REQUIRE(T.IsInline() == false);
+    REQUIRE(T[0] == "x");
+    *T.AddEmpty() = "y";
+    REQUIRE(T.back() == "y");
+  }
+}
+
+TEST_CASE("segmented_lot", "Various tests of the functionality of 'segmented_lot'") {
+  segmented_lot<int, 2> A;
+  SECTION("Elements never move") {
+    int* first = A.AddEmpty();
+    *first = -1;
+    int* tenth = nullptr;
+    for (int i = 1; i < 10000; i++) {
+      A.Add(i);
+      if (i == 10) tenth = &A[10];
+    }
+    REQUIRE(first == &A[0]);
+    REQUIRE(tenth == &A[10]);
+    REQUIRE(*tenth == 10);
+    bool indexed = true;
+    for (ui32 i = 1; i < A.size(); i++) indexed = indexed && A[i] == static_cast<int>(i);
+    REQUIRE(indexed);
+    REQUIRE(A.capacity() == 16380); // 4+8+...+8192
+  }
+  SECTION("Iteration") {
+    for (int i = 0; i < 1000; i++) A.Add(i);
+    int sum = 0, n = 0;
+    for (int x : A) { sum += x; n++; }
+    REQUIRE(n == 1000);
+    REQUIRE(sum == 499500);
+    ui32 seen = 0;
+    A.ForEachChunk([&seen](int* p, ui32 m, ui32 at) { if (p[0] == static_cast<int>(at)) seen += m; });
+    REQUIRE(seen == 1000);
+    A.resize(4);
+    n = 0;
+    for (int x : A) n += x;
+    REQUIRE(n == 6);
+    A.clear();
+    REQUIRE(A.begin() == A.end());
+  }
+  SECTION("Capacity") {
+    A.reserve(100);
+    REQUIRE(A.capacity() == 124);
+    REQUIRE(A.ChunkCount() == 5);
+    A.resize(13);
+    A.shrink_to_fit();
+    REQUIRE(A.ChunkCount() == 3);
+    REQUIRE(A.capacity() == 4 + 8 + 16);
+    A.Free();
+    REQUIRE(A.capacity() == 0);
+    A.Add(1, 2, 3, 4, 5);
+    REQUIRE(A.back() == 5);
+    REQUIRE(A.front() == 1);
+  }
+  SECTION("Copy, move, append and take") {
+    segmented_lot<string> S = { "a","b","c" };
+    segmented_lot<string> T(S);
+    for (int i = 0; i < 100; i++) T.Add(S);
+    REQUIRE(T.size() == 303);
+    REQUIRE(T[301] == "b");
+    T.Add(T);
+    REQUIRE(T[605] == "c");
+    segmented_lot<string> U(move(T));
+    REQUIRE(T.size() == 0);
+    REQUIRE(U[4] == "b");
+    S.Take(U);
+    REQUIRE(S.size() == 609);
+    REQUIRE(S[608] == "c");
+    REQUIRE(U.size() == 0);
+    string* stable = &S[3];
+    U.Take(S);
+    REQUIRE(&U[3] == stable);
+    T = U;
+    REQUIRE(T[608] == "c");
+    segmented_lot<int, 4, true> C(3);
+    REQUIRE_THROWS_AS(C[3], out_of_range);
+  }
+}
+
+struct particle { float x, y, z; int id; string name; };
+
+TEST_CASE("soa_lot", "Structure of arrays") {
+  typedef soa_lot<float, float, int, string> soa;
+  SECTION("Columns in one block") {
+    soa S;
+    for (int i = 0; i < 1000; i++) S.Add(float(i), float(2 * i), i, to_string(i));
+    REQUIRE(S.size() == 1000);
+    REQUIRE(S.capacity() >= 1000);
+    REQUIRE(S.data<1>()[500] == 1000.f);
+    REQUIRE(S[999].get<3>() == "999");
+    REQUIRE(S.get<2>(7) == 7);
+    REQUIRE(reinterpret_cast<size_t>(S.data<0>()) % 64 == 0);
+    REQUIRE(reinterpret_cast<size_t>(S.data<2>()) % 64 == 0);
+    REQUIRE(reinterpret_cast<char*>(S.data<3>() + S.capacity()) <= reinterpret_cast<char*>(S.data<0>()) + soa::Bytes(S.capacity())); // All in one block
+    REQUIRE(lot_simd::Sum(S.data<0>(), S.size()) == 499500.f);
+    auto r = S.AddEmpty();
+    r.get<3>() = "new";
+    S.Add(make_tuple(1.f, 2.f, 3, string("tuple")));
+    REQUIRE(S[1000].get<3>() == "new");
+    REQUIRE(get<2>(tuple<float, float, int, string>(S.back())) == 3);
+    S.shrink_to_fit();
+    REQUIRE(S.capacity() == S.size());
+    REQUIRE(S[10].get<3>() == "10"); // Moved along with the block
+  }
+  SECTION("Row iterator and proxies") {
+    soa S(10);
+    int n = 0;
+    for (auto row : S) { row = make_tuple(float(n), 0.f, n, string()); n++; }
+    REQUIRE(S.data<2>()[9] == 9);
+    S[3] = S[9];
+    REQUIRE(S[3].get<0>() == 9.f);
+    REQUIRE(S.end() - S.begin() == 10);
+    REQUIRE((*(S.begin() + 4)).get<2>() == 4);
+    REQUIRE(count_if(S.begin(), S.end(), [](soa::row r) { return r.get<2>() == 9; }) == 2);
+    typedef basic_soa_lot<tuple<int, float>, true> checked;
+    checked K(2);
+    REQUIRE_THROWS_AS(K[2], out_of_range);
+  }
+  SECTION("Take, copies and conversion from and to lot<struct>") {
+    lot<particle> P(100);
+    for (ui32 i = 0; i < P.size(); i++) P[i] = particle{ float(i), 1.f, 2.f, int(i), to_string(i) };
+    soa_lot<float, int, string> A;
+    A.FromLot(P, &particle::x, &particle::id, &particle::name);
+    REQUIRE(A.size() == 100);
+    REQUIRE(A[42].get<2>() == "42");
+    soa_lot<float, int, string> B(A), C;
+    C.Take(B);
+    REQUIRE(B.size() == 0);
+    C.Take(A);
+    REQUIRE(C.size() == 200);
+    REQUIRE(C[142].get<2>() == "42");
+    C.Add(C);
+    REQUIRE(C[399].get<1>() == 99);
+    lot<particle> Q;
+    C.ToLot(Q, &particle::x, &particle::id, &particle::name);
+    REQUIRE(Q.size() == 400);
+    REQUIRE(Q[250].name == "50");
+    REQUIRE(Q[250].x == 50.f);
+    C.Free();
+    REQUIRE(C.capacity() == 0);
+  }
+}
+
+template<class T> void simd_check(lot_simd::level level) { // Every kernel against a plain loop, with sizes which leave a tail behind the lanes
+  lot_simd::SetLevel(level);
+  for (ui32 n : { 0u, 1u, 7u, 100u, 1003u, 70001u }) {
+    lot<T> A(n), B(n), C;
+    lot_simd::Iota(A, T(1), T(2));
+    bool ok = true;
+    for (ui32 i = 0; i < n; i++) ok = ok && A[i] == T(1 + 2 * i);
+    REQUIRE(ok);
+    for (ui32 i = 0; i < n; i++) A[i] = T((i * 37) % 101);
+    lot_simd::Fill(B, T(3));
+    REQUIRE(lot_simd::Count(B, T(3)) == n);
+    lot_simd::Axpy(B, T(2), A);
+    lot_simd::Add(C, A, B);
+    ok = true;
+    for (ui32 i = 0; i < n; i++) ok = ok && B[i] == T(3 + 2 * A[i]) && C[i] == T(3 + 3 * A[i]);
+    REQUIRE(ok);
+    lot_simd::Sub(C, C, A);
+    lot_simd::Mul(C, C, A);
+    lot_simd::Scale(C, T(2));
+    ok = true;
+    for (ui32 i = 0; i < n; i++) ok = ok && C[i] == T(2 * B[i] * A[i]);
+    REQUIRE(ok);
+    typename lot_simd_acc<T>::type sum = 0;
+    double dot = 0;
+    for (ui32 i = 0; i < n; i++) { sum += A[i]; dot += double(A[i]) * double(B[i]); }
+    REQUIRE(lot_simd::Sum(A) == sum); // Exact, all values are small integers
+    REQUIRE(lot_simd::SumKahan(A) == sum);
+    REQUIRE(fabs(double(lot_simd::Dot(A, B)) - dot) <= 1e-6 * dot); // Rounded in another order for float
+    REQUIRE(lot_simd::Count(A, T(100)) == size_t(count(A.begin(), A.end(), T(100))));
+    REQUIRE(lot_simd::Find(A, T(100)) == size_t(find(A.begin(), A.end(), T(100)) - A.begin()));
+    REQUIRE(lot_simd::Find(A, T(200)) == n);
+    if (n <= 1) {
+      if (n == 0) REQUIRE_THROWS_AS(lot_simd::Min(A), out_of_range);
+      REQUIRE(lot_simd::ArgMax(A) == 0);
+      continue;
+    }
+    A[n / 2] = T(200);
+    A[n - 1] = T(0);
+    REQUIRE(lot_simd::Max(A) == T(200));
+    REQUIRE(lot_simd::ArgMax(A) == n / 2);
+    REQUIRE(lot_simd::Min(A) == T(0));
+    REQUIRE(lot_simd::ArgMin(A) == size_t(min_element(A.begin(), A.end()) - A.begin()));
+    lot_simd::Clamp(A, T(10), T(50));
+    REQUIRE(*min_element(A.begin(), A.end()) == T(10));
+    REQUIRE(*max_element(A.begin(), A.end()) == T(50));
+  }
+}
+
+TEST_CASE("lot_simd", "Vectorized kernels on every instruction set") {
+  lot_simd::level best = lot_simd::Supported();
+  for (int l = lot_simd::scalar; l <= best; l++) {
+    INFO(lot_simd::Name(lot_simd::level(l)));
+    simd_check<float>(lot_simd::level(l));
+    simd_check<double>(lot_simd::level(l));
+    simd_check<int32_t>(lot_simd::level(l));
+    simd_check<ui32>(lot_simd::level(l));
+    lot<int32_t> N(1003); // Negative, and beyond 31 bits, for the extension to 64 bit sums
+    lot<ui32> U(1003);
+    lot_simd::Iota(N, -1000000, 2003);
+    lot_simd::Iota(U, 4000000000u, 7u);
+    int64_t sn = 0, dn = 0;
+    ui64 su = 0, du = 0;
+    for (ui32 i = 0; i < 1003; i++) { sn += N[i]; dn += int64_t(N[i]) * N[i]; su += U[i]; du += ui64(U[i]) * U[i]; }
+    REQUIRE(lot_simd::Sum(N) == sn);
+    REQUIRE(lot_simd::Dot(N, N) == dn);
+    REQUIRE(lot_simd::Sum(U) == su);
+    REQUIRE(lot_simd::Dot(U, U) == du);
+  }
+  SECTION("Accurate sums") {
+    lot<float> A(1000000);
+    lot_simd::Fill(A, 0.1f);
+    float naive = 0;
+    for (float x : A) naive += x;
+    REQUIRE(fabs(double(lot_simd::SumKahan(A)) - 100000.0) < 0.01);
+    REQUIRE(fabs(double(lot_simd::Sum(A)) - 100000.0) < 1);
+    REQUIRE(fabs(double(naive) - 100000.0) > 100); // What both of them avoid
+    lot<int32_t> I(10);
+    lot_simd::Fill(I, 2000000000);
+    REQUIRE(lot_simd::Sum(I) == 20000000000LL); // Wider than int32_t
+    lot<int32_t, true> J(5), K(4);
+    REQUIRE_THROWS_AS(lot_simd::Dot(J, K), length_error);
+  }
+  if (best >= lot_simd::ssse3) { // Every CPU with AVX2 has SSSE3 too
+    lot_simd::SetLevel(lot_simd::ssse3);
+    REQUIRE(lot_simd::Level() == lot_simd::ssse3);
+    REQUIRE(string(lot_simd::Name(lot_simd::Level())) == "ssse3");
+  }
+  lot_simd::SetLevel(best);
+}
+
+template<class P> void packed_check(lot<ui32>& V) { // Random access, bulk decoding and scans against the plain values
+  P A;
+  A.Add(V);
+  REQUIRE(A.size() == V.size());
+  bool ok = true;
+  for (ui32 i = 0; i < V.size(); i += 7) ok = ok && A[i] == V[i];
+  REQUIRE(ok);
+  REQUIRE(A.back() == V.back());
+  lot<ui32> W;
+  A.ToLot(W);
+  REQUIRE(equal(W.begin(), W.end(), V.begin()));
+  W.resize(300);
+  A.Decode(61, 300, W.data()); // Starts and ends within blocks
+  REQUIRE(equal(W.begin(), W.end(), V.begin() + 61));
+  ui64 sum = 0, expected = 0;
+  ui32 next = 0;
+  A.ForEachBlock([&](const ui32* p, ui32 n, ui32 at) {
+    ok = ok && at == next;
+    next += n;
+    for (ui32 i = 0; i < n; i++) sum += p[i];
+  });
+  for (ui32 x : V) expected += x;
+  REQUIRE(ok);
+  REQUIRE(sum == expected);
+}
+
+TEST_CASE("packed_lot", "Bit packed and delta compressed lots of indices") {
+  lot<ui32> R, S;
+  ui32 seed = 1, s = 0;
+  for (ui32 i = 0; i < 10000; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    R.Add(seed >> 12); // 20 bits
+    S.Add(s += (seed >> 28) + (i % 1000 == 999 ? 100000 : 0)); // Small gaps, and a few large ones
+  }
+  R.Add(0xFFFFFFFFu, 0u, 7u); // Full width, and a tail
+  S.Add(s, s + 1, 0u); // Zero gap, and one which wraps around
+  lot_simd::level best = lot_simd::Supported();
+  for (int l = lot_simd::scalar; l <= best; l++) {
+    INFO(lot_simd::Name(lot_simd::level(l)));
+    lot_simd::SetLevel(lot_simd::level(l));
+    packed_check<packed_lot<lot_pack_bits>>(R);
+    packed_check<packed_lot<lot_pack_bits>>(S);
+    packed_check<packed_lot<lot_pack_delta>>(R);
+    packed_check<packed_lot<lot_pack_delta>>(S);
+  }
+  lot_simd::SetLevel(best);
+  SECTION("Compression") {
+    packed_lot<lot_pack_bits> B;
+    packed_lot<lot_pack_delta> D;
+    lot<ui32> C(65536);
+    for (ui32 i = 0; i < C.size(); i++) C[i] = 1000000 + (i % 100) * 3; // 9 bits above the minimum
+    B.Add(C);
+    B.shrink_to_fit();
+    REQUIRE(B.MemoryBytes() < C.size() * 4 / 3);
+    for (ui32 i = 0; i < C.size(); i++) C[i] = i * 5;
+    D.Add(C);
+    D.shrink_to_fit();
+    REQUIRE(D.MemoryBytes() < C.size() * 4 / 2); // 1 byte and 2 bits per value
+    REQUIRE(D[40000] == 200000);
+    D.Free();
+    REQUIRE(D.size() == 0);
+    D.Add(1u);
+    REQUIRE(D[0] == 1);
+    int x = 2;
+    D.Add(x); // Not taken for a container
+    segmented_lot<ui32> G;
+    for (ui32 i = 0; i < 1000; i++) G.Add(i + 3);
+    D.Add(G); // Not contiguous
+    REQUIRE(D.size() == 1002);
+    REQUIRE(D[1] == 2);
+    REQUIRE(D[1001] == 1002);
+    packed_lot<lot_pack_bits, true> E;
+    REQUIRE_THROWS_AS(E[0], out_of_range);
+  }
+}
+
 TEST_CASE("lots_malloc","Various tests of the functionality of 'lots', using adapter_malloc") {
   lots<adapter_malloc<int>,int> A;
   lots<adapter_malloc<int>,int> B = {3,4,5};
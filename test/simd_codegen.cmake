@@ -0,0 +1,35 @@
+# Checks that every entry point of lot_simd in LIB (see simd_codegen.cpp) has packed instructions on the registers of its instruction set, run as: cmake -DOBJDUMP=... -DLIB=... -P simd_codegen.cmake
+execute_process(COMMAND ${OBJDUMP} -d -C --no-show-raw-insn ${LIB} OUTPUT_VARIABLE asm RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${OBJDUMP} failed on ${LIB}")
+endif()
+string(REPLACE ";" "," asm "${asm}")
+string(REPLACE "\n" ";" asm "${asm}")
+set(packed "\t(v?(add|sub|mul|min|max|cmp[a-z]*|blendv?|and|or|xor)p[sd]|v?p(add|sub|mul|cmp|min|max|blend|and|or)[a-z]*|v?mov(up|ap|dq)[a-z0-9]*) ")
+set(functions 0)
+set(failed "")
+foreach(line IN LISTS asm)
+  if(line MATCHES "^[0-9a-f]+ <(.*)>:$")
+    set(name "${CMAKE_MATCH_1}")
+    set(register "")
+    if(name MATCHES "lot_simd_(sse2|avx2|avx512)::")
+      set(register "${CMAKE_MATCH_1}")
+      string(REPLACE "sse2" "%xmm" register "${register}")
+      string(REPLACE "avx512" "%zmm" register "${register}")
+      string(REPLACE "avx2" "%ymm" register "${register}")
+      math(EXPR functions "${functions} + 1")
+      list(APPEND failed "${name}") # Until a packed instruction shows up
+    endif()
+  elseif(register AND line MATCHES "${packed}" AND line MATCHES "${register}")
+    list(REMOVE_ITEM failed "${name}")
+    set(register "")
+  endif()
+endforeach()
+if(functions EQUAL 0)
+  message(FATAL_ERROR "No entry points of lot_simd in ${LIB}")
+endif()
+if(failed)
+  string(REPLACE ";" "\n  " failed "${failed}")
+  message(FATAL_ERROR "Scalar code only:\n  ${failed}")
+endif()
+message(STATUS "${functions} entry points of lot_simd have vector code")
@@ -0,0 +1,24 @@
+#include "mz/lot_simd.h"
+// The entry points of lot_simd for every instruction set and type, compiled with optimization, so that simd_codegen.cmake can check that they are vector code
+
+#define MZ_CODEGEN(S,T) \
+  template void std::mz::S::Fill<T>(T*, size_t, T); \
+  template void std::mz::S::Iota<T>(T*, size_t, T, T); \
+  template void std::mz::S::Axpy<T>(T*, const T*, size_t, T); \
+  template void std::mz::S::Scale<T>(T*, size_t, T); \
+  template void std::mz::S::Add<T>(T*, const T*, const T*, size_t); \
+  template void std::mz::S::Sub<T>(T*, const T*, const T*, size_t); \
+  template void std::mz::S::Mul<T>(T*, const T*, const T*, size_t); \
+  template void std::mz::S::Clamp<T>(T*, size_t, T, T); \
+  template std::mz::lot_simd_acc<T>::type std::mz::S::Sum<T>(const T*, size_t); \
+  template std::mz::lot_simd_acc<T>::type std::mz::S::SumKahan<T>(const T*, size_t); \
+  template std::mz::lot_simd_acc<T>::type std::mz::S::Dot<T>(const T*, const T*, size_t); \
+  template T std::mz::S::Min<T>(const T*, size_t); \
+  template T std::mz::S::Max<T>(const T*, size_t); \
+  template size_t std::mz::S::Count<T>(const T*, size_t, T); \
+  template size_t std::mz::S::Find<T>(const T*, size_t, T);
+#define MZ_CODEGEN_TYPES(S) MZ_CODEGEN(S,float) MZ_CODEGEN(S,double) MZ_CODEGEN(S,int32_t) MZ_CODEGEN(S,ui32)
+
+MZ_CODEGEN_TYPES(lot_simd_sse2)
+MZ_CODEGEN_TYPES(lot_simd_avx2)
+MZ_CODEGEN_TYPES(lot_simd_avx512)